@@ -35,6 +35,7 @@
 /**************************************************************************/
 
 #include "Adafruit_ATParser.h"
+#include "utility/TimeoutTimer.h"
 
 static inline char digit2ascii(uint8_t digit)
 {
@@ -50,6 +51,7 @@ Adafruit_ATParser::Adafruit_ATParser(void)
 {
   _mode    = BLUEFRUIT_MODE_COMMAND;
   _verbose = false;
+  perfReset();
 }
 
 /******************************************************************************/
@@ -60,6 +62,7 @@ Adafruit_ATParser::Adafruit_ATParser(void)
 /******************************************************************************/
 bool Adafruit_ATParser::waitForOK(void)
 {
+  BLE_PERF_SCOPE(BLE_PERF_WAITFOROK);
   if (_verbose) SerialDebug.print( F("\n<- ") );
 
   // Use temp buffer to avoid overwrite returned result if any
@@ -152,6 +155,7 @@ bool Adafruit_ATParser::send_arg_get_resp(int32_t* reply, uint8_t argcount, uint
 /******************************************************************************/
 bool Adafruit_ATParser::atcommand_full(const char cmd[], int32_t* reply, uint8_t argcount, uint16_t argtype[], uint32_t args[])
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   bool result;
   uint8_t current_mode = _mode;
 
@@ -176,6 +180,7 @@ bool Adafruit_ATParser::atcommand_full(const char cmd[], int32_t* reply, uint8_t
 /******************************************************************************/
 bool Adafruit_ATParser::atcommand_full(const __FlashStringHelper *cmd, int32_t* reply, uint8_t argcount, uint16_t argtype[], uint32_t args[])
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   bool result;
   uint8_t current_mode = _mode;
 
@@ -192,6 +197,32 @@ bool Adafruit_ATParser::atcommand_full(const __FlashStringHelper *cmd, int32_t*
   return result;
 }
 
+/******************************************************************************/
+/*!
+    @brief Send a preformatted command line and check for OK. Skips the
+           per-argument print() calls of atcommand_full.
+    @param[in] frame Complete command, including the "\r\n" terminator
+    @param[in] len Length of frame
+*/
+/******************************************************************************/
+bool Adafruit_ATParser::atcommandFrame(char const frame[], uint16_t len)
+{
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
+  bool result;
+  uint8_t current_mode = _mode;
+
+  // switch mode if necessary to execute command
+  if ( current_mode == BLUEFRUIT_MODE_DATA ) setMode(BLUEFRUIT_MODE_COMMAND);
+
+  write((uint8_t const*) frame, len);
+  result = waitForOK();
+
+  // switch back if necessary
+  if ( current_mode == BLUEFRUIT_MODE_DATA ) setMode(BLUEFRUIT_MODE_DATA);
+
+  return result;
+}
+
 /******************************************************************************/
 /*!
     @brief Send an AT command and get multiline string response into
@@ -206,6 +237,7 @@ bool Adafruit_ATParser::atcommand_full(const __FlashStringHelper *cmd, int32_t*
 /******************************************************************************/
 uint16_t Adafruit_ATParser::atcommandStrReply(const char cmd[], char* buf, uint16_t bufsize, uint16_t timeout)
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   uint16_t result_bytes;
   uint8_t current_mode = _mode;
   // switch mode if necessary to execute command
@@ -223,6 +255,7 @@ uint16_t Adafruit_ATParser::atcommandStrReply(const char cmd[], char* buf, uint1
 
 uint16_t Adafruit_ATParser::atcommandStrReply(const __FlashStringHelper *cmd, char* buf, uint16_t bufsize, uint16_t timeout)
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   uint16_t result_bytes;
   uint8_t current_mode = _mode;
   // switch mode if necessary to execute command
@@ -257,6 +290,7 @@ uint16_t Adafruit_ATParser::atcommandStrReplyPerLine(
     char* linebuf, uint16_t bufsize, uint16_t timeout,
     void (*line_callback)(void*, char*, uint16_t), void* callback_data)
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   uint16_t result_bytes;
   uint8_t current_mode = _mode;
   // switch mode if necessary to execute command
@@ -282,6 +316,7 @@ uint16_t Adafruit_ATParser::atcommandStrReplyPerLine(
     char* linebuf, uint16_t bufsize, uint16_t timeout,
     void (*line_callback)(void*, char*, uint16_t), void* callback_data)
 {
+  BLE_PERF_SCOPE(BLE_PERF_ATCOMMAND);
   uint16_t result_bytes;
   uint8_t current_mode = _mode;
   // switch mode if necessary to execute command
@@ -326,8 +361,9 @@ int32_t Adafruit_ATParser::readline_parseInt(void)
     @brief  Get a line of response data into provided buffer.
 
     @param[in] buf Provided buffer
-    @param[in] bufsize buffer size
-    @param[in] timeout timeout in milliseconds
+    @param[in] bufsize maximum characters to read; buf must hold bufsize+1
+               bytes since the terminator is written at buf[bufsize]
+    @param[in] timeout timeout in milliseconds for the whole line
     @param[in] multiline Read multiple line if true, otherwise only read 1 line
 
     @note '\r' and '\n' are not included in returned buffer.
@@ -335,9 +371,12 @@ int32_t Adafruit_ATParser::readline_parseInt(void)
 /******************************************************************************/
 uint16_t Adafruit_ATParser::readline(char * buf, uint16_t bufsize, uint16_t timeout, boolean multiline)
 {
+  BLE_PERF_SCOPE(BLE_PERF_READLINE);
   uint16_t replyidx = 0;
+  bool done = false;
+  TimeoutTimer tt(timeout);
 
-  while (timeout--) {
+  while (!done) {
     while(available()) {
       char c = read();
       //SerialDebug.println(c);
@@ -349,7 +388,7 @@ uint16_t Adafruit_ATParser::readline(char * buf, uint16_t bufsize, uint16_t time
         if (replyidx == 0) continue;
 
         if (!multiline) {
-          timeout = 0;
+          done = true;
           break;
         }
       }
@@ -359,13 +398,14 @@ uint16_t Adafruit_ATParser::readline(char * buf, uint16_t bufsize, uint16_t time
       // Buffer is full
       if (replyidx >= bufsize) {
         //if (_verbose) { SerialDebug.println("*overflow*"); }  // for my debuggin' only!
-        timeout = 0;
+        done = true;
         break;
       }
     }
 
-    // delay if needed
-    if (timeout) delay(1);
+    // wait for more data if needed
+    if (done || tt.expired()) break;
+    waitForData();
   }
 
   buf[replyidx] = 0;  // null term
@@ -387,7 +427,7 @@ uint16_t Adafruit_ATParser::readline(char * buf, uint16_t bufsize, uint16_t time
             OK or ERROR
 
     @param[in] timeout
-               Timeout for each read() operation
+               Timeout in milliseconds for the whole response
 
     @return    The number of bytes read excluding OK, ERROR ending.
                0 usually means error
@@ -396,8 +436,10 @@ uint16_t Adafruit_ATParser::readline(char * buf, uint16_t bufsize, uint16_t time
 uint16_t Adafruit_ATParser::readraw(uint16_t timeout)
 {
   uint16_t replyidx = 0;
+  bool done = false;
+  TimeoutTimer tt(timeout);
 
-  while (timeout--) {
+  while (!done) {
     while(available()) {
       char c =  read();
 
@@ -407,14 +449,14 @@ uint16_t Adafruit_ATParser::readraw(uint16_t timeout)
         if ( (replyidx >= 3) && !strncmp(this->buffer + replyidx-3, "OK\r", 3) )
         {
           replyidx -= 3; // chop OK\r
-          timeout = 0;
+          done = true;
           break;
         }
         // done if ends with "ERROR\r\n"
         else if ((replyidx >= 6) && !strncmp(this->buffer + replyidx-6, "ERROR\r", 6))
         {
           replyidx -= 6; // chop ERROR\r
-          timeout = 0;
+          done = true;
           break;
         }
       }
@@ -425,13 +467,13 @@ uint16_t Adafruit_ATParser::readraw(uint16_t timeout)
       // Buffer is full
       if (replyidx >= BLE_BUFSIZE) {
         //if (_verbose) { SerialDebug.println("*overflow*"); }  // for my debuggin' only!
-        timeout = 0;
+        done = true;
         break;
       }
     }
 
-    if (timeout == 0) break;
-    delay(1);
+    if (done || tt.expired()) break;
+    waitForData();
   }
   this->buffer[replyidx] = 0;  // null term
 
@@ -465,3 +507,28 @@ int Adafruit_ATParser::printByteArray(uint8_t const bytearray[], int size)
 
   return (size*3) - 1;
 }
+
+/******************************************************************************/
+/*!
+    @brief Format a byte array as printByteArray would, into a buffer
+    @param[out] dst Needs room for 3*size-1 characters (not terminated)
+    @return number of characters written
+*/
+/******************************************************************************/
+uint16_t Adafruit_ATParser::formatByteArray(char* dst, uint8_t const bytearray[], uint16_t size)
+{
+  static const char hex_lut[16] PROGMEM = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+  char* const start = dst;
+
+  while(size--)
+  {
+    uint8_t byte = *bytearray++;
+    *dst++ = pgm_read_byte(&hex_lut[byte >> 4]);
+    *dst++ = pgm_read_byte(&hex_lut[byte & 0x0F]);
+    if ( size!=0 ) *dst++ = '-';
+  }
+
+  return dst - start;
+}
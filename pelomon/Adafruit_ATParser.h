@@ -67,15 +67,67 @@ enum
   AT_ARGTYPE_UINT8     = 0x0800,
 };
 
+// Per-operation latency counters, dumped by the sketch's bleperf command.
+// Operations nest (an AT command includes its waitForOK, which includes
+// readline, which includes SDEP receives), so each total is inclusive.
+// Set to 0 to compile the instrumentation out.
+#define BLE_PERF 1
+
+enum
+{
+  BLE_PERF_ATCOMMAND = 0,
+  BLE_PERF_WAITFOROK,
+  BLE_PERF_READLINE,
+  BLE_PERF_SDEP_SEND,
+  BLE_PERF_SDEP_RECV,
+  BLE_PERF_UART_TX,
+  BLE_PERF_COUNT
+};
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t total_us;
+  uint32_t max_us;
+} blePerfStat_t;
+
+#if BLE_PERF
+// Charges the lifetime of the enclosing scope to one counter
+class BLEPerfScope
+{
+  blePerfStat_t& _stat;
+  uint32_t _start;
+public:
+  BLEPerfScope(blePerfStat_t& stat) : _stat(stat), _start(micros()) {}
+  ~BLEPerfScope()
+  {
+    uint32_t elapsed = micros() - _start;
+    _stat.count++;
+    _stat.total_us += elapsed;
+    if (elapsed > _stat.max_us) _stat.max_us = elapsed;
+  }
+};
+#define BLE_PERF_SCOPE(op) BLEPerfScope _perf_scope(_perf[op])
+#else
+#define BLE_PERF_SCOPE(op)
+#endif
+
 class Adafruit_ATParser : public Stream
 {
 protected:
   uint8_t _mode;
   bool     _verbose;
+#if BLE_PERF
+  blePerfStat_t _perf[BLE_PERF_COUNT];
+#endif
 
   // internal function
   bool send_arg_get_resp(int32_t* reply, uint8_t argcount, uint16_t argtype[], uint32_t args[]);
 
+  // Called by readline/readraw while no response data is available.
+  // Transports that can wait on the module's IRQ line override this.
+  virtual void waitForData(void) { delay(1); }
+
 public:
   Adafruit_ATParser(void);
 
@@ -87,9 +139,24 @@ public:
   // Auto print out TX & RX data to normal Serial
   void verbose(bool enable) { _verbose = enable; }
 
+  // Latency counters, indexed by BLE_PERF_*; NULL if compiled out
+#if BLE_PERF
+  const blePerfStat_t* perfStats(void) const { return _perf; }
+  void perfReset(void) { memset(_perf, 0, sizeof(_perf)); }
+#else
+  const blePerfStat_t* perfStats(void) const { return NULL; }
+  void perfReset(void) {}
+#endif
+
   bool atcommand_full(const char cmd[]               , int32_t* reply, uint8_t argcount, uint16_t argtype[], uint32_t args[]);
   bool atcommand_full(const __FlashStringHelper *cmd , int32_t* reply, uint8_t argcount, uint16_t argtype[], uint32_t args[]);
 
+  // Fast path for hot commands: send a fully formatted, "\r\n" terminated
+  // command line in one transport call and wait for OK
+  bool atcommandFrame(char const frame[], uint16_t len);
+  // Render bytes as "XX-XX-..." hex into dst; returns characters written
+  static uint16_t formatByteArray(char* dst, uint8_t const bytearray[], uint16_t size);
+
   //--------------------------------------------------------------------+
   // Without Reply
   //--------------------------------------------------------------------+
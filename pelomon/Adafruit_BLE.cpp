@@ -295,6 +295,11 @@ void Adafruit_BLE::update(uint32_t period_ms)
     bool v = _verbose;
     _verbose = false;
 
+    // Bound the time spent polling: the module answers event queries within
+    // a few ms, so don't let a missing reply stall for the full _timeout.
+    unsigned long prev_timeout = _timeout;
+    _timeout = BLE_UPDATE_TIMEOUT;
+
     uint8_t current_mode = _mode;
 
     // switch mode if necessary to execute command
@@ -320,10 +325,13 @@ void Adafruit_BLE::update(uint32_t period_ms)
 
     if ( this->_ble_uart_rx_callback && bitRead(system_event, EVENT_SYSTEM_BLE_UART_RX) )
     {
-      // _verbose = true;
-      println( F("AT+BLEUARTRX") );
-      uint16_t len = readline(tempbuf, BLE_BUFSIZE);
-      waitForOK();
+      // Drain the module's UART FIFO in DATA mode: unlike AT+BLEUARTRX this
+      // keeps line endings intact, and stops as soon as the FIFO is empty
+      // rather than waiting out a timeout.
+      setMode(BLUEFRUIT_MODE_DATA);
+      uint16_t len = 0;
+      while ( len < BLE_BUFSIZE && available() ) tempbuf[len++] = read();
+      setMode(BLUEFRUIT_MODE_COMMAND);
 
       this->_ble_uart_rx_callback( (char*) tempbuf, len);
     }
@@ -355,7 +363,8 @@ void Adafruit_BLE::update(uint32_t period_ms)
     if ( this->_ble_gatt_rx_callback && gatts_event )
     {
 //      _verbose = true;
-      for(uint8_t charid=1; charid < 30; charid++)
+      // stop once no pending events remain for higher characteristic IDs
+      for(uint8_t charid=1; charid < 30 && (gatts_event >> (charid-1)); charid++)
       {
         if ( bitRead(gatts_event, charid-1) )
         {
@@ -373,6 +382,7 @@ void Adafruit_BLE::update(uint32_t period_ms)
     // switch back if necessary
     if ( current_mode == BLUEFRUIT_MODE_DATA ) setMode(BLUEFRUIT_MODE_DATA);
 
+    _timeout = prev_timeout;
     _verbose = v;
   }
 }
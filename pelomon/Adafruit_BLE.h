@@ -45,6 +45,7 @@
 #include "Adafruit_ATParser.h"
 
 #define BLE_DEFAULT_TIMEOUT      250
+#define BLE_UPDATE_TIMEOUT       10   // per-reply timeout while polling events in update()
 
 enum BLEDataType_t
 {
@@ -187,10 +187,29 @@ uint8_t Adafruit_BLEGatt::addCharacteristic(uint8_t uuid128[], uint8_t propertie
 /******************************************************************************/
 bool Adafruit_BLEGatt::setChar(uint8_t charID, uint8_t const data[], uint8_t size)
 {
-  uint16_t argtype[] = { AT_ARGTYPE_UINT8, (uint16_t) (AT_ARGTYPE_BYTEARRAY+ size) };
-  uint32_t args[] = { charID, (uint32_t) data };
+  // This is the per-update hot path, so build the whole command line here
+  // from a PROGMEM prefix and hand it to the transport in one go
+  static const char prefix[] PROGMEM = "AT+GATTCHAR=";
+  if ( size == 0 || size > GATT_CHAR_FRAME_MAX_DATA )
+  {
+    uint16_t argtype[] = { AT_ARGTYPE_UINT8, (uint16_t) (AT_ARGTYPE_BYTEARRAY+ size) };
+    uint32_t args[] = { charID, (uint32_t) data };
 
-  return _ble.atcommand_full(F("AT+GATTCHAR"), NULL, 2, argtype, args);
+    return _ble.atcommand_full(F("AT+GATTCHAR"), NULL, 2, argtype, args);
+  }
+
+  char frame[sizeof(prefix) - 1 + 4 + 3*GATT_CHAR_FRAME_MAX_DATA + 1];
+  uint8_t len = sizeof(prefix) - 1;
+  memcpy_P(frame, prefix, len);
+  if ( charID >= 100 ) frame[len++] = '0' + charID / 100;
+  if ( charID >= 10  ) frame[len++] = '0' + (charID / 10) % 10;
+  frame[len++] = '0' + charID % 10;
+  frame[len++] = ',';
+  len += Adafruit_ATParser::formatByteArray(frame + len, data, size);
+  frame[len++] = '\r';
+  frame[len++] = '\n';
+
+  return _ble.atcommandFrame(frame, len);
 }
 
 /******************************************************************************/
@@ -56,6 +56,9 @@ struct GattPresentationFormat
   uint16_t desc;
 };
 
+// Largest value setChar formats on its fast path (the ATT default MTU limit)
+#define GATT_CHAR_FRAME_MAX_DATA 20
+
 class Adafruit_BLEGatt
 {
 private:
@@ -36,6 +36,7 @@
 #include "Adafruit_BluefruitLE_SPI.h"
 #include <Arduino.h>
 #include <stdlib.h>
+#include <avr/sleep.h>
 
 #ifndef min
   #define min(a,b) ((a) < (b) ? (a) : (b))
@@ -71,6 +72,7 @@ Adafruit_BluefruitLE_SPI::Adafruit_BluefruitLE_SPI(int8_t csPin, int8_t irqPin,
   m_tx_count = 0;
 
   m_mode_switch_command_enabled = true;
+  m_irq_attached = false;
 }
 
 /******************************************************************************/
@@ -108,6 +110,7 @@ Adafruit_BluefruitLE_SPI::Adafruit_BluefruitLE_SPI(int8_t clkPin, int8_t misoPin
   m_tx_count = 0;
 
   m_mode_switch_command_enabled = true;
+  m_irq_attached = false;
 }
 
 
@@ -126,6 +129,14 @@ bool Adafruit_BluefruitLE_SPI::begin(boolean v, boolean blocking)
 
   pinMode(m_irq_pin, INPUT);
 
+  // Wake from idle sleep as soon as the module raises IRQ. The handler does
+  // no SPI work itself, so it can't collide with a transfer in progress.
+  if ( digitalPinToInterrupt(m_irq_pin) != NOT_AN_INTERRUPT )
+  {
+    attachInterrupt(digitalPinToInterrupt(m_irq_pin), irqWake, RISING);
+    m_irq_attached = true;
+  }
+
   // Set CS pin to output and de-assert by default
   pinMode(m_cs_pin, OUTPUT);
   digitalWrite(m_cs_pin, HIGH);
@@ -177,11 +188,58 @@ bool Adafruit_BluefruitLE_SPI::begin(boolean v, boolean blocking)
 /******************************************************************************/
 void Adafruit_BluefruitLE_SPI::end(void)
 {
+  if (m_irq_attached) {
+    detachInterrupt(digitalPinToInterrupt(m_irq_pin));
+    m_irq_attached = false;
+  }
   if (m_sck_pin == -1) {
     SPI.end();
   }
 }
 
+/******************************************************************************/
+/*!
+    @brief  IRQ pin handler. Nothing to do: taking the interrupt is enough to
+            wake the CPU out of idle sleep in idleUntilIrq().
+*/
+/******************************************************************************/
+void Adafruit_BluefruitLE_SPI::irqWake(void)
+{
+}
+
+/******************************************************************************/
+/*!
+    @brief  Idle the CPU until IRQ is raised or any other interrupt fires
+            (timer0 ticks at ~1kHz, so this returns within about 1ms).
+            Interrupt-driven peripherals such as SoftwareSerial RX keep
+            running while we sleep.
+*/
+/******************************************************************************/
+void Adafruit_BluefruitLE_SPI::idleUntilIrq(void)
+{
+  cli();
+  if ( digitalRead(m_irq_pin) )
+  {
+    sei();
+    return;
+  }
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();        // the instruction after sei always runs, so no wakeup is lost
+  sleep_cpu();
+  sleep_disable();
+}
+
+/******************************************************************************/
+/*!
+    @brief  Wait for more response data (used by readline/readraw)
+*/
+/******************************************************************************/
+void Adafruit_BluefruitLE_SPI::waitForData(void)
+{
+  idleUntilIrq();
+}
+
 /******************************************************************************/
 /*!
     @brief Handle direct "+++" input command from user.
@@ -254,6 +312,8 @@ bool Adafruit_BluefruitLE_SPI::sendInitializePattern(void)
 /******************************************************************************/
 bool Adafruit_BluefruitLE_SPI::sendPacket(uint16_t command, const uint8_t* buf, uint8_t count, uint8_t more_data)
 {
+  BLE_PERF_SCOPE(BLE_PERF_SDEP_SEND);
+
   // flush old response before sending the new command, but only if we're *not*
   // in DATA mode, as the RX FIFO may containg incoming UART data that hasn't
   // been read yet
@@ -366,6 +426,7 @@ size_t Adafruit_BluefruitLE_SPI::write(const uint8_t *buf, size_t size)
 {
   if ( _mode == BLUEFRUIT_MODE_DATA )
   {
+    BLE_PERF_SCOPE(BLE_PERF_UART_TX);
     if (m_mode_switch_command_enabled &&
         (size >= 3) &&
         !memcmp(buf, "+++", 3) &&
@@ -560,11 +621,14 @@ bool Adafruit_BluefruitLE_SPI::getResponse(void)
 /******************************************************************************/
 bool Adafruit_BluefruitLE_SPI::getPacket(sdepMsgResponse_t* p_response)
 {
+  BLE_PERF_SCOPE(BLE_PERF_SDEP_RECV);
+
   // Wait until IRQ is asserted, double timeout since some commands take long time to start responding
   TimeoutTimer tt(2*_timeout);
   
   while ( !digitalRead(m_irq_pin) ) {
     if (tt.expired()) return false;
+    idleUntilIrq();
   }
   
   sdepMsgHeader_t* p_header = &p_response->header;
@@ -73,6 +73,13 @@ class Adafruit_BluefruitLE_SPI : public Adafruit_BLE
 
     bool            m_mode_switch_command_enabled;
 
+    // IRQ line wired to an external interrupt, used to wake from idle sleep
+    // while waiting for a response. Callers still block for the whole AT
+    // transaction; only the wait itself stops burning cycles.
+    bool            m_irq_attached;
+    static void     irqWake(void);
+    void            idleUntilIrq(void);
+
     // Low level transportation I/O functions
     bool    sendInitializePattern(void);
     bool    sendPacket(uint16_t command, const uint8_t* buffer, uint8_t count, uint8_t more_data);
@@ -82,6 +89,11 @@ class Adafruit_BluefruitLE_SPI : public Adafruit_BLE
     void    simulateSwitchMode(void);
 //    bool    handleSwitchCmdInDataMode(uint8_t ch);
 
+  protected:
+    virtual void waitForData(void);
+
+  private:
+
     uint8_t spixfer(uint8_t x);
     void spixfer(void *x, size_t len);
 
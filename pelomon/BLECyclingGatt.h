@@ -21,9 +21,8 @@
     base += sizeof(field);
 
 
-uint16_t fletcher16(const char* str, uint16_t len) {
-    uint8_t lo, hi;
-    lo = hi = 0;
+uint16_t fletcher16(const char* str, uint16_t len, const uint16_t init = 0) {
+    uint8_t lo = init & 0xFF, hi = init >> 8;
     for (; len > 0; len--, str++) {
         lo += *str;
         hi += lo;
@@ -34,6 +33,20 @@ uint16_t fletcher16(const char* str, uint16_t len) {
     return rv;
 }
 
+// As above, but over a PROGMEM buffer, continuing from a previous result
+// so several buffers can be chained into one checksum.
+uint16_t fletcher16_P(const char* pstr, uint16_t len, const uint16_t init) {
+    uint8_t lo = init & 0xFF, hi = init >> 8;
+    for (; len > 0; len--, pstr++) {
+        lo += pgm_read_byte(pstr);
+        hi += lo;
+    }
+    uint16_t rv = hi;
+    rv <<= 8;
+    rv |= lo;
+    return rv;
+}
+
 // These strings don't end up referenced anywhere so the compiler removes them.
 const char line_1[] PROGMEM = "ID=01,UUID=0x1818";
 const char line_2[] PROGMEM = "  ID=01,UUID=0x2A65,PROPERTIES=0x02,MIN_LEN=4,MAX_LEN=4,DATATYPE=0,VALUE=0";
@@ -44,11 +57,30 @@ const char line_6[] PROGMEM = "  ID=04,UUID=0x2A5C,PROPERTIES=0x02,MIN_LEN=2,MAX
 const char line_7[] PROGMEM = "  ID=05,UUID=0x2A5B,PROPERTIES=0x10,MIN_LEN=11,MAX_LEN=11,DATATYPE=0,VALUE=00-00-00-00-00-00-00-00-00-00-00";
 const char line_8[] PROGMEM = "  ID=06,UUID=0x2A5D,PROPERTIES=0x02,MIN_LEN=1,MAX_LEN=1,DATATYPE=0,VALUE=0";
 const char line_9[] PROGMEM = "  ID=07,UUID=0x2A55,PROPERTIES=0x28,MIN_LEN=1,MAX_LEN=5,DATATYPE=0,VALUE=0";
+// Size of the protocol health block (layout in protocol_health.h); the
+// health characteristic's lengths in line_h2 below must match.
+#define HEALTH_BLOCK_LEN 18
+#ifdef ENABLE_HEALTH_GATT
+// Custom service 7E0A0001-3C5B-4E9A-9D61-7A8E2B5C4F10, health block 7E0A0002-...
+const char line_h1[] PROGMEM = "ID=03,UUID=0x0001,UUID128=7E-0A-00-01-3C-5B-4E-9A-9D-61-7A-8E-2B-5C-4F-10";
+const char line_h2[] PROGMEM = "  ID=08,UUID=0x0002,UUID128=7E-0A-00-02-3C-5B-4E-9A-9D-61-7A-8E-2B-5C-4F-10,PROPERTIES=0x02,MIN_LEN=18,MAX_LEN=18,DATATYPE=0,VALUE=00-00-00-00-00-00-00-00-00-00-00-00-00-00-00-00-00-00";
+#endif
+// Room for the longest line above (line_h2, 184 chars; else line_7, 107)
+// plus readline()'s terminator, so no line comes back split
+#ifdef ENABLE_HEALTH_GATT
+#define GATTLIST_LINE_BUF_LEN 192
+#else
+#define GATTLIST_LINE_BUF_LEN 128
+#endif
 const char line_10[] PROGMEM = "OK";
 
 const char* const EXPECTED_GATT_DEFNS[] PROGMEM = {line_1, line_2, line_3,
                                                    line_4, line_5, line_6, line_7,
-                                                   line_8, line_9, line_10};
+                                                   line_8, line_9,
+#ifdef ENABLE_HEALTH_GATT
+                                                   line_h1, line_h2,
+#endif
+                                                   line_10};
 
 
 // Computed from above strings using following Python
@@ -70,10 +102,36 @@ uint16_t const EXPECTED_GATT_DEFNS_FLETCHER16[] PROGMEM = {
     0x4DB9, //  "  ID=05,UUID=0x2A5B,PROPERTIES=0x10,MIN_LEN=11,MAX_LEN=11,DATATYPE=0,VALUE=00-00-00-00-00-00-00-00-00-00-00"
     0x05A9, //  "  ID=06,UUID=0x2A5D,PROPERTIES=0x02,MIN_LEN=1,MAX_LEN=1,DATATYPE=0,VALUE=0"
     0x93A7, //  "  ID=07,UUID=0x2A55,PROPERTIES=0x28,MIN_LEN=1,MAX_LEN=5,DATATYPE=0,VALUE=0"
+#ifdef ENABLE_HEALTH_GATT
+    0x4442, //  line_h1
+    0x1A8B, //  line_h2
+#endif
     0xE99A, //  "OK"
 };
-const uint8_t EXPECTED_GATT_DEFNS_LINE_COUNT = 10;
-
+const uint8_t EXPECTED_GATT_DEFNS_LINE_COUNT = (sizeof(EXPECTED_GATT_DEFNS_FLETCHER16) /
+                                                sizeof(EXPECTED_GATT_DEFNS_FLETCHER16[0]));
+
+/* Advertising data:
+https://www.bluetooth.com/specifications/assigned-numbers/generic-access-profile/
+https://github.com/sputnikdev/bluetooth-gatt-parser/blob/master/src/main/resources/
+        gatt/characteristic/org.bluetooth.characteristic.gap.appearance.xml
+    02 01 06:          Flags -- LE General Discoverable, BR/EDR Not Supported
+    02 0A 00:          Tx power -- 0 dBm
+    11 06 9E...6E      128-bit service UUID 6E...9E (UART SERVICE)
+    05 02 18 18 16 18  16-bit service UUIDs
+                         0x1818 (CYCLING POWER SERVICE)
+                         0x1816 (CYCLING SPEED/CADENCE SERVICE)
+The module writes advertising data to its own flash and only starts sending
+it after a reset (ATZ), so it can't carry live ride data: every refresh would
+be a flash write and a dropped connection.
+*/
+const char GAP_DEVNAME_COMMAND[] PROGMEM = "AT+GAPDEVNAME=PeloMon";
+const char GAP_ADVDATA_COMMAND[] PROGMEM =
+    "AT+GAPSETADVDATA="
+    "02-01-06-"
+    "02-0a-00-"
+    "11-06-9e-ca-dc-24-0e-e5-a9-e0-93-f3-a3-b5-01-00-40-6e-"
+    "05-02-18-18-16-18";
 
 struct ProgmemComparatorState {
     bool is_equal;
@@ -84,7 +142,11 @@ struct ProgmemComparatorState {
 
 void fletcher16_comparator_callback(void* callback_data, char* linebuf, uint16_t line_len) {
     ProgmemComparatorState* state = (ProgmemComparatorState*) callback_data;
-    if (state->line_number >= state->total_lines) return;
+    if (state->line_number >= state->total_lines) {
+        // More GATT lines than we defined
+        state->is_equal = false;
+        return;
+    }
 
     uint16_t* pgm_hash_table = (uint16_t*) (state->pgm_entry_table);
 
@@ -96,16 +158,25 @@ void fletcher16_comparator_callback(void* callback_data, char* linebuf, uint16_t
     state->is_equal = (state->is_equal && hashes_matched);
     state->line_number++;
 
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
         char logbuf[128];
         snprintf_P(logbuf, 32, PSTR("\tfinal matching %d"), state->is_equal ? 1 : 0);
         Serial.println(logbuf);
     }
 }
 
+// Folds every reply line into the uint16_t checksum at callback_data
+void fletcher16_chain_callback(void* callback_data, char* linebuf, uint16_t line_len) {
+    uint16_t* checksum = (uint16_t*) callback_data;
+    *checksum = fletcher16(linebuf, line_len, *checksum);
+}
+
 void string_comparator_callback(void* callback_data, char* linebuf, uint16_t line_len) {
     ProgmemComparatorState* state = (ProgmemComparatorState*) callback_data;
-    if (state->line_number >= state->total_lines) return;
+    if (state->line_number >= state->total_lines) {
+        state->is_equal = false;
+        return;
+    }
 
     char** pgm_line_table = (char**) (state->pgm_entry_table);
 
@@ -114,7 +185,7 @@ void string_comparator_callback(void* callback_data, char* linebuf, uint16_t lin
 
     const uint16_t next_pgm_line_len = strnlen_P(next_pgm_line, line_len+1);
     const int lines_matched = strncmp_P(linebuf, next_pgm_line, line_len);
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
         char logbuf[128];
         Serial.print(F("Checking lines:\n\t"));
         Serial.println(linebuf);
@@ -132,7 +203,7 @@ void string_comparator_callback(void* callback_data, char* linebuf, uint16_t lin
                        && (line_len == next_pgm_line_len)
                        && (0 == lines_matched));
     state->line_number++;
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
         char logbuf[128];
         snprintf_P(logbuf, 32, PSTR("\tfinal matching %d"), state->is_equal ? 1 : 0);
         Serial.println(logbuf);
@@ -165,40 +236,75 @@ class BLECyclingPower {
     uint8_t csc_measurement_id;
     uint8_t csc_sensor_location_id;
     uint8_t sc_control_point_id;
+#ifdef ENABLE_HEALTH_GATT
+    uint8_t health_service_id;
+    uint8_t health_char_id;
+    unsigned long last_health_ts;
+#endif
+
+    // Last SC Control Point write, filled in by the GATT RX callback and
+    // serviced by handle_sc_control_point(). Zero length = nothing pending.
+    uint8_t sc_cp_request[SC_CONTROL_POINT_MAX_LENGTH];
+    uint8_t sc_cp_request_len;
+    bool cumulative_value_pending;
+    uint32_t cumulative_value;
+
+    // The Adafruit callback carries no user data, so route it via the
+    // (single) instance that registered it.
+    static BLECyclingPower* control_point_instance;
+    static void sc_control_point_rx_callback(int32_t chars_id, uint8_t data[], uint16_t len) {
+        BLECyclingPower* self = control_point_instance;
+        if (self == NULL || chars_id != self->sc_control_point_id) return;
+        if (len > SC_CONTROL_POINT_MAX_LENGTH) len = SC_CONTROL_POINT_MAX_LENGTH;
+        memcpy(self->sc_cp_request, data, len);
+        self->sc_cp_request_len = len;
+    }
 
     public:
-    BLECyclingPower(Adafruit_BLE& ble, Logger& logger_): ble_(ble), gatt_(ble), logger(logger_) {};
+    BLECyclingPower(Adafruit_BLE& ble, Logger& logger_): ble_(ble), gatt_(ble), logger(logger_),
+        sc_cp_request_len(0), cumulative_value_pending(false), cumulative_value(0) {
+#ifdef ENABLE_HEALTH_GATT
+        last_health_ts = 0;
+#endif
+    };
 
     void initialize() {
-        // If we haven't set up the module and GATTs/characteristics, do so.
-        load_or_setup_gatts();
-        
-        // Software reset module on bringup
-        ble_.reset();
-
-        // Set up advertising data and name
-        ble_.sendCommandCheckOK(F("AT+GAPDEVNAME=PeloMon"));
-        /* Advertising data:
-        https://www.bluetooth.com/specifications/assigned-numbers/generic-access-profile/
-        https://github.com/sputnikdev/bluetooth-gatt-parser/blob/master/src/main/resources/
-                gatt/characteristic/org.bluetooth.characteristic.gap.appearance.xml
-            02 01 06:          Flags -- LE General Discoverable, BR/EDR Not Supported
-            02 0A 00:          Tx power -- 0 dBm
-            11 06 9E...6E      128-bit service UUID 6E...9E (UART SERVICE)
-            05 02 18 18 16 18  16-bit service UUIDs
-                                 0x1818 (CYCLING POWER SERVICE)
-                                 0x1816 (CYCLING SPEED/CADENCE SERVICE)
-        */
-        ble_.sendCommandCheckOK(
-            F("AT+GAPSETADVDATA="
-              "02-01-06-"
-              "02-0a-00-"
-              "11-06-9e-ca-dc-24-0e-e5-a9-e0-93-f3-a3-b5-01-00-40-6e-"
-              "05-02-18-18-16-18"
-              ));
-        ble_.reset();
-
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+        const uint16_t fingerprint = config_fingerprint();
+        bool cached = false;
+        if (stored_config_fingerprint() == fingerprint) {
+            // The module keeps GATTs, name and advertising data in its own
+            // flash, and we already verified them on a previous boot: skip
+            // the GATTLIST readback and the two resets. A factory reset on
+            // the module side leaves ATI as it was but empties the GATT
+            // table, so check one of our characteristics is still there.
+            load_gatt_ids();
+            cached = (gatt_.getChar(cp_sensor_location_id) > 0);
+        }
+        if (cached) {
+            logger.print(F("BLE config cached\n"));
+        } else {
+            // If we haven't set up the module and GATTs/characteristics, do so.
+            load_or_setup_gatts();
+
+            // Software reset module on bringup
+            ble_.reset();
+
+            // Set up advertising data and name
+            const bool adv_ok = (
+                ble_.sendCommandCheckOK((const __FlashStringHelper*) GAP_DEVNAME_COMMAND) &&
+                ble_.sendCommandCheckOK((const __FlashStringHelper*) GAP_ADVDATA_COMMAND));
+            ble_.reset();
+
+            // Only trust the cache next boot if everything took
+            if (adv_ok && gatts_as_expected()) {
+                EEPROM.update(EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS,
+                              fingerprint & 0xFF);
+                EEPROM.update(EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS + 1,
+                              fingerprint >> 8);
+            }
+        }
+
+        if (log_enabled<LOG_LEVEL_DEBUG>()) {
             logger.print(F("Checking GATTs\n"));
             ble_.sendCommandCheckOK(F("AT+GATTLIST"));
         }
@@ -216,12 +322,42 @@ class BLECyclingPower {
                                   CSCF_WHEEL_REVOLUTION_DATA_SUPPORTED));
         const uint8_t zero = 0;
         gatt_.setChar(sc_control_point_id, &zero, 1);
+
+        // Deliver control point writes via ble_.update() polling
+        control_point_instance = this;
+        ble_.setBleGattRxCallback(sc_control_point_id, sc_control_point_rx_callback);
         return;
     }
 
+    uint16_t config_fingerprint() {
+        // Covers the module itself (ATI: its serial number and firmware
+        // versions, so a swapped or updated module misses the cache) and
+        // everything it persists for us: the GATT table (via the per-line
+        // hashes of the expected GATTLIST), name and adv data.
+        // NB: like gatts_as_expected, depends on EXPECTED_GATT_DEFNS being
+        // kept in sync with the GATT setup.
+        char linebuf[32];
+        uint16_t fingerprint = 0;
+        ble_.atcommandStrReplyPerLine(F("ATI"), linebuf, sizeof(linebuf) - 1, 100,
+                                      fletcher16_chain_callback, &fingerprint);
+        fingerprint = fletcher16_P(
+            (const char*) EXPECTED_GATT_DEFNS_FLETCHER16,
+            sizeof(EXPECTED_GATT_DEFNS_FLETCHER16), fingerprint);
+        fingerprint = fletcher16_P(GAP_DEVNAME_COMMAND,
+                                   strlen_P(GAP_DEVNAME_COMMAND), fingerprint);
+        fingerprint = fletcher16_P(GAP_ADVDATA_COMMAND,
+                                   strlen_P(GAP_ADVDATA_COMMAND), fingerprint);
+        return fingerprint;
+    }
+
+    uint16_t stored_config_fingerprint() const {
+        return (EEPROM.read(EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS + 1) << 8) |
+                EEPROM.read(EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS);
+    }
+
     bool gatts_as_expected() {
         // NB: this function must be updated if gatt setup is changed
-        char linebuf[128];
+        char linebuf[GATTLIST_LINE_BUF_LEN];
 
         // Set up a comparator to be called on a line-by-line basis.
         ProgmemComparatorState comparator;
@@ -230,9 +366,17 @@ class BLECyclingPower {
         comparator.total_lines = EXPECTED_GATT_DEFNS_LINE_COUNT;
         comparator.pgm_entry_table = (void*) EXPECTED_GATT_DEFNS_FLETCHER16;
 
-        // Allow 100ms between sending command and getting reply
-        ble_.atcommandStrReplyPerLine(F("AT+GATTLIST"), linebuf, 128, 100,
+        // Allow 100ms between sending command and getting reply.
+        // readline() terminates at linebuf[bufsize], so leave room for it.
+        ble_.atcommandStrReplyPerLine(F("AT+GATTLIST"), linebuf,
+                                      GATTLIST_LINE_BUF_LEN - 1, 100,
                                       fletcher16_comparator_callback, &comparator);
+        // The parser stops on the closing "OK" without passing it to the
+        // callback, so every line before it must have been seen. Fewer
+        // lines than we defined is a mismatch too.
+        if (comparator.line_number != comparator.total_lines - 1) {
+            comparator.is_equal = false;
+        }
         if (!comparator.is_equal) {
             logger.print(F("GATTs incorrect\n"));
         }
@@ -252,6 +396,13 @@ class BLECyclingPower {
             gatt_.clear();
             setup_cycling_power_feature();
             setup_cycling_speed_cadence_feature();
+#ifdef ENABLE_HEALTH_GATT
+            setup_health_feature();
+            EEPROM.update(EEPROM_BLE_HEALTH_SERVICE_ID_ADDRESS,
+                          (uint8_t) health_service_id);
+            EEPROM.update(EEPROM_BLE_HEALTH_CHAR_ID_ADDRESS,
+                          (uint8_t) health_char_id);
+#endif
 
             // Store initialization to EEPROM
             EEPROM.update(EEPROM_BLE_CP_SERVICE_ID_ADDRESS,
@@ -273,19 +424,27 @@ class BLECyclingPower {
             EEPROM.update(EEPROM_BLE_SC_CONTROL_POINT_ID_ADDRESS,
                           (uint8_t) sc_control_point_id);
         } else {
-            // Load IDs from EEPROM rather than reinitializing
-            cp_service_id = EEPROM.read(EEPROM_BLE_CP_SERVICE_ID_ADDRESS);
-            cp_feature_id = EEPROM.read(EEPROM_BLE_CP_FEATURE_ID_ADDRESS);
-            cp_measurement_id = EEPROM.read(EEPROM_BLE_CP_MEASUREMENT_ID_ADDRESS);
-            cp_sensor_location_id = EEPROM.read(EEPROM_BLE_CP_SENSOR_LOCATION_ID_ADDRESS);
-            csc_service_id = EEPROM.read(EEPROM_BLE_CSC_SERVICE_ID_ADDRESS);
-            csc_feature_id = EEPROM.read(EEPROM_BLE_CSC_FEATURE_ID_ADDRESS);
-            csc_measurement_id = EEPROM.read(EEPROM_BLE_CSC_MEASUREMENT_ID_ADDRESS);
-            csc_sensor_location_id = EEPROM.read(EEPROM_BLE_CSC_SENSOR_LOCATION_ID_ADDRESS);
-            sc_control_point_id = EEPROM.read(EEPROM_BLE_SC_CONTROL_POINT_ID_ADDRESS);
+            load_gatt_ids();
         }
     }
 
+    void load_gatt_ids() {
+        // Load IDs from EEPROM rather than reinitializing
+        cp_service_id = EEPROM.read(EEPROM_BLE_CP_SERVICE_ID_ADDRESS);
+        cp_feature_id = EEPROM.read(EEPROM_BLE_CP_FEATURE_ID_ADDRESS);
+        cp_measurement_id = EEPROM.read(EEPROM_BLE_CP_MEASUREMENT_ID_ADDRESS);
+        cp_sensor_location_id = EEPROM.read(EEPROM_BLE_CP_SENSOR_LOCATION_ID_ADDRESS);
+        csc_service_id = EEPROM.read(EEPROM_BLE_CSC_SERVICE_ID_ADDRESS);
+        csc_feature_id = EEPROM.read(EEPROM_BLE_CSC_FEATURE_ID_ADDRESS);
+        csc_measurement_id = EEPROM.read(EEPROM_BLE_CSC_MEASUREMENT_ID_ADDRESS);
+        csc_sensor_location_id = EEPROM.read(EEPROM_BLE_CSC_SENSOR_LOCATION_ID_ADDRESS);
+        sc_control_point_id = EEPROM.read(EEPROM_BLE_SC_CONTROL_POINT_ID_ADDRESS);
+#ifdef ENABLE_HEALTH_GATT
+        health_service_id = EEPROM.read(EEPROM_BLE_HEALTH_SERVICE_ID_ADDRESS);
+        health_char_id = EEPROM.read(EEPROM_BLE_HEALTH_CHAR_ID_ADDRESS);
+#endif
+    }
+
     void setup_cycling_power_feature() {
         cp_service_id = gatt_.addService(CYCLING_POWER_SERVICE_UUID);
 
@@ -364,71 +523,112 @@ class BLECyclingPower {
             /* presentFormat */ NULL);
     }
 
+#ifdef ENABLE_HEALTH_GATT
+    void setup_health_feature() {
+        // Read-only protocol health block; layout in protocol_health.h
+        uint8_t uuid[16] = {0x7E, 0x0A, 0x00, 0x01, 0x3C, 0x5B, 0x4E, 0x9A,
+                            0x9D, 0x61, 0x7A, 0x8E, 0x2B, 0x5C, 0x4F, 0x10};
+        health_service_id = gatt_.addService(uuid);
+        uuid[3] = 0x02;
+        health_char_id = gatt_.addCharacteristic(
+            /* uuid          */ uuid,
+            /* properties    */ GATT_CHARS_PROPERTIES_READ,
+            /* min_len       */ HEALTH_BLOCK_LEN,
+            /* max_len       */ HEALTH_BLOCK_LEN,
+            /* datatype      */ BLE_DATATYPE_AUTO,
+            /* description   */ NULL,
+            /* presentFormat */ NULL);
+    }
+
+    bool health_update_due(const unsigned long now) const {
+        return now - last_health_ts >= HEALTH_GATT_UPDATE_INTERVAL_MILLIS;
+    }
+
+    void update_health(const uint8_t* block, const uint8_t len,
+                       const unsigned long now) {
+        last_health_ts = now;
+        gatt_.setChar(health_char_id, block, len);
+    }
+#endif
+
+    static uint8_t pack_cp_measurement(uint8_t* data, uint16_t power_watts,
+                                       const uint16_t total_energy_kj) {
+        // CP Measurement format specified in
+        // https://github.com/oesmith/gatt-xml/blob/master/
+        //    org.bluetooth.characteristic.cycling_power_measurement.xml
+
+        /* NB: We will report wheel and crank revs in the CSC characteristic
+         * rather than here. We'll only use CPM for power and energy.
+         * CP and CSC use different time resolutions for wheel revs, and
+         * exposing both according to their specs gives Wahoo a fit - never
+         * figures out what the right speed is since they have different
+         * time resolution.
+         */
+
+        uint8_t base = 0;
+        // flags: mandatory, 16 bit bitfield
+        uint16_t flags = (CPM_ACCUMULATED_ENERGY_PRESENT);
+        APPEND_BUFFER(data, base, flags);
+
+        // Instantaneous power: mandatory sint16 in Watts
+        // Clamp the uint16 input to avoid overflowing the sint16 expected by BT spec
+        if (power_watts > 0x7FFF) power_watts = 0x7FFF;
+        APPEND_BUFFER(data, base, power_watts);
+
+        // 3.2.1.12 accumulated energy is in kJ uint16
+        APPEND_BUFFER(data, base, total_energy_kj);
+        return base;
+    }
+
+    static uint8_t pack_csc_measurement(uint8_t* data, const uint16_t crank_revs,
+                                        const uint32_t last_crank_rev_timestamp_ms,
+                                        const uint32_t wheel_revs,
+                                        const uint32_t last_wheel_rev_timestamp_ms) {
+        // Set up the CSC measurement with wheel and crank revs.
+        // https://github.com/oesmith/gatt-xml/blob/master/
+        // org.bluetooth.characteristic.csc_measurement.xml
+        uint8_t base = 0;
+        // Flags: uint8
+        uint8_t csc_flags = (CSCM_WHEEL_REV_DATA_PRESENT |
+                             CSCM_CRANK_REV_DATA_PRESENT);
+        APPEND_BUFFER(data, base, csc_flags);
+
+        // Cumulative wheel revs uint32
+        APPEND_BUFFER(data, base, wheel_revs);
+        // Last wheel rev event time: uint16, 1/1024s resolution
+        // NB! Time resolution for wheel revs is lower in CSC than in CP!
+        // CP would expect 1/2048.
+        uint16_t last_wheel_event_time_csc = \
+            (uint16_t) ((last_wheel_rev_timestamp_ms * 128) / 125);
+        APPEND_BUFFER(data, base, last_wheel_event_time_csc);
+
+        // Cumulative crank revs uint16
+        APPEND_BUFFER(data, base, crank_revs);
+        // Last Crank event time uint16 in 1/1024s units
+        uint16_t last_crank_event_time = \
+            (uint16_t) ((last_crank_rev_timestamp_ms * 128) / 125);
+        APPEND_BUFFER(data, base, last_crank_event_time);
+        return base;
+    }
+
     bool update(const uint16_t crank_revs, const uint32_t last_crank_rev_timestamp_ms,
                 const uint32_t wheel_revs, const uint32_t last_wheel_rev_timestamp_ms,
                 uint16_t power_watts, const uint16_t total_energy_kj) {
         uint8_t data[11] = {0};
-        uint8_t base;
+        uint8_t len;
         const bool update_cp = true;
         const bool update_csc = true;
         bool cpm_success = true;
         bool csc_success = true;
         if (update_cp) {
-            // CP Measurement format specified in
-            // https://github.com/oesmith/gatt-xml/blob/master/
-            //    org.bluetooth.characteristic.cycling_power_measurement.xml
-
-            /* NB: We will report wheel and crank revs in the CSC characteristic
-             * rather than here. We'll only use CPM for power and energy.
-             * CP and CSC use different time resolutions for wheel revs, and
-             * exposing both according to their specs gives Wahoo a fit - never
-             * figures out what the right speed is since they have different
-             * time resolution.
-             */
-
-            base = 0;
-            // flags: mandatory, 16 bit bitfield
-            uint16_t flags = (CPM_ACCUMULATED_ENERGY_PRESENT);
-            APPEND_BUFFER(data, base, flags);
-
-            // Instantaneous power: mandatory sint16 in Watts
-            // Clamp the uint16 input to avoid overflowing the sint16 expected by BT spec
-            if (power_watts > 0x7FFF) power_watts = 0x7FFF;
-            APPEND_BUFFER(data, base, power_watts);
-
-            // 3.2.1.12 accumulated energy is in kJ uint16
-            APPEND_BUFFER(data, base, total_energy_kj);
-
-            cpm_success = gatt_.setChar(cp_measurement_id, data, base);
+            len = pack_cp_measurement(data, power_watts, total_energy_kj);
+            cpm_success = gatt_.setChar(cp_measurement_id, data, len);
         }
 
         if (update_csc) {
-            // Set up the CSC measurement with wheel and crank revs.
-            // https://github.com/oesmith/gatt-xml/blob/master/
-            // org.bluetooth.characteristic.csc_measurement.xml
-            base = 0;
-            // Flags: uint8
-            uint8_t csc_flags = (CSCM_WHEEL_REV_DATA_PRESENT |
-                                 CSCM_CRANK_REV_DATA_PRESENT);
-            APPEND_BUFFER(data, base, csc_flags);
-
-            // Cumulative wheel revs uint32
-            APPEND_BUFFER(data, base, wheel_revs);
-            // Last wheel rev event time: uint16, 1/1024s resolution
-            // NB! Time resolution for wheel revs is lower in CSC than in CP!
-            // CP would expect 1/2048.
-            uint16_t last_wheel_event_time_csc = \
-                (uint16_t) ((last_wheel_rev_timestamp_ms * 128) / 125);
-            APPEND_BUFFER(data, base, last_wheel_event_time_csc);
-
-            // Cumulative crank revs uint16
-            APPEND_BUFFER(data, base, crank_revs);
-            // Last Crank event time uint16 in 1/1024s units
-            uint16_t last_crank_event_time = \
-                (uint16_t) ((last_crank_rev_timestamp_ms * 128) / 125);
-            APPEND_BUFFER(data, base, last_crank_event_time);
-
-            csc_success = gatt_.setChar(csc_measurement_id, data, base);
+            len = pack_csc_measurement(data, crank_revs, last_crank_rev_timestamp_ms,
+                                       wheel_revs, last_wheel_rev_timestamp_ms);
+            csc_success = gatt_.setChar(csc_measurement_id, data, len);
         }
 
         handle_sc_control_point();
@@ -436,13 +636,53 @@ class BLECyclingPower {
     }
 
     void handle_sc_control_point() {
-        // We don't actually need to handle anything here for the Garmin to
-        // connect. Some other devices might actually care about proper
-        // responses.
-        // In principle we could update the total number of wheel revs
-        // but we don't persist that anyway.
-        // This should probably be handled by ble_.setBleGattRxCallback()?
-        return;
+        // Respond to a pending control point write. The Garmin doesn't need
+        // this to connect, but the CSC spec and some head units expect it.
+        if (sc_cp_request_len == 0) return;
+        const uint8_t opcode = sc_cp_request[0];
+        uint8_t response[SC_CONTROL_POINT_MAX_LENGTH];
+        uint8_t len = 0;
+        response[len++] = SC_CONTROL_POINT_OP_RESPONSE_CODE;
+        response[len++] = opcode;
+        if (opcode == SC_CONTROL_POINT_OP_SET_CUMULATIVE_VALUE) {
+            // uint32 cumulative wheel revolutions, little-endian
+            if (sc_cp_request_len != 5) {
+                response[len++] = SC_CONTROL_POINT_RESPONSE_INVALID_PARAMETER;
+            } else {
+                memcpy(&cumulative_value, sc_cp_request + 1, 4);
+                cumulative_value_pending = true;
+                response[len++] = SC_CONTROL_POINT_RESPONSE_SUCCESS;
+            }
+        } else if (opcode == SC_CONTROL_POINT_OP_REQUEST_SUPPORTED_SENSOR_LOCATIONS) {
+            response[len++] = SC_CONTROL_POINT_RESPONSE_SUCCESS;
+            response[len++] = SENSOR_LOCATION_LEFT_CRANK;
+        } else if (opcode == SC_CONTROL_POINT_OP_UPDATE_SENSOR_LOCATION) {
+            // We only live in one place
+            const bool ok = (sc_cp_request_len == 2 &&
+                             sc_cp_request[1] == SENSOR_LOCATION_LEFT_CRANK);
+            response[len++] = ok ? SC_CONTROL_POINT_RESPONSE_SUCCESS
+                                 : SC_CONTROL_POINT_RESPONSE_INVALID_PARAMETER;
+        } else {
+            response[len++] = SC_CONTROL_POINT_RESPONSE_OPCODE_NOT_SUPPORTED;
+        }
+        sc_cp_request_len = 0;
+
+        if (log_enabled<LOG_LEVEL_DEBUG>()) {
+            char logbuf[32];
+            snprintf_P(logbuf, 32, PSTR("SC CP op %hhu -> %hhu\n"),
+                       opcode, response[2]);
+            logger.print(logbuf);
+        }
+        // Characteristic is INDICATE, so setting it sends the response
+        gatt_.setChar(sc_control_point_id, response, len);
+    }
+
+    bool cumulative_value_requested(uint32_t& value) {
+        // Returns true once per Set Cumulative Value received
+        if (!cumulative_value_pending) return false;
+        value = cumulative_value;
+        cumulative_value_pending = false;
+        return true;
     }
 
     void serial_status_text() const {
@@ -463,5 +703,6 @@ class BLECyclingPower {
         logger.print(buf);
     }
 };
+BLECyclingPower* BLECyclingPower::control_point_instance = NULL;
 
 #endif
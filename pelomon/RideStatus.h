@@ -17,6 +17,10 @@ class RideStatus {
     unsigned long last_wheel_rev_timestamp;
     float total_crank_revolutions;
     float total_wheel_revolutions;
+    // Whole wheel revs folded out of the float accumulator (and any value
+    // seeded by a Set Cumulative Value request), so the cumulative count
+    // neither loses FP32 precision nor resets between rides.
+    uint32_t wheel_revolution_offset;
     float total_energy_kj;
     float current_mph;
     uint16_t current_rpm;
@@ -39,24 +43,11 @@ class RideStatus {
         }
         return;
     }
-    float mph_from_power(const uint16_t power_deciwatts) const {
-        // Derived from piecewise polynomial regression on a dataset of
-        // about 150 rides. Regression done on watts but bike provides
-        // watts * 10.
-        const float power = ((float) power_deciwatts) * 0.1f;
-        const float rtpower = sqrt(power);
-        const float coefs_low[4] = {-0.07605, 0.74063, -0.14023, 0.04660};
-        const float coefs_high[4] = {0.00087, -0.05685, 2.23594, -1.31158};
-        const float* const coefs = power < 27.0f ? coefs_low : coefs_high;
-        float mph = 0;
-        for (uint8_t i=0; i < 3; i++) {
-            mph += coefs[i];
-            mph *= rtpower;
-        }
-        mph += coefs[3];
-        return mph;
+    void fold_wheel_revolutions() {
+        const unsigned long whole_revs = (unsigned long) total_wheel_revolutions;
+        wheel_revolution_offset += whole_revs;
+        total_wheel_revolutions -= whole_revs;
     }
-
     void update_new_rpm(const uint16_t new_rpm) {
         /* Update rpm and total crank revs since last rpm message.
          */
@@ -88,7 +79,11 @@ class RideStatus {
         if (last_power_timestamp == 0 || (ts - last_power_timestamp) > 5000) {
             // Reset our counter if we never saw data or saw it >5s ago
             last_power_timestamp = last_wheel_rev_timestamp = ts;
-            total_energy_kj = total_wheel_revolutions = 0.0f;
+            total_energy_kj = 0.0f;
+            // Wheel revs are cumulative per the CSC spec: keep the whole
+            // revs and only drop the partial one.
+            fold_wheel_revolutions();
+            total_wheel_revolutions = 0.0f;
         }
         // Update stored values
         const unsigned long elapsed_ms = ts - last_power_timestamp;
@@ -121,9 +116,7 @@ class RideStatus {
                              increm_wheel_revs, rev_per_ms, ts);
         if (total_wheel_revolutions > 16777215.0f) {
              // Prevent FP32 loss of precision
-             // Technically this is non-compliant - we should never roll over
-             // But I don't want to deal with keeping the rest of the 32b elsewhere.
-             total_wheel_revolutions -= (unsigned long) total_wheel_revolutions;
+             fold_wheel_revolutions();
         }
     }
     void update_new_resistance(const uint16_t new_raw_resistance,
@@ -133,11 +126,34 @@ class RideStatus {
     }
     public:
     RideStatus(Logger& logger_): logger(logger_) {};
+    float mph_from_power(const uint16_t power_deciwatts) const {
+        // Derived from piecewise polynomial regression on a dataset of
+        // about 150 rides. Regression done on watts but bike provides
+        // watts * 10.
+        const float power = ((float) power_deciwatts) * 0.1f;
+        const float rtpower = sqrt(power);
+        const float coefs_low[4] = {-0.07605, 0.74063, -0.14023, 0.04660};
+        const float coefs_high[4] = {0.00087, -0.05685, 2.23594, -1.31158};
+        const float* const coefs = power < 27.0f ? coefs_low : coefs_high;
+        float mph = 0;
+        for (uint8_t i=0; i < 3; i++) {
+            mph += coefs[i];
+            mph *= rtpower;
+        }
+        mph += coefs[3];
+        return mph;
+    }
     void initialize() {
         current_rpm = current_power_deciwatt = current_raw_resistance = current_resistance = 0;
         total_crank_revolutions = total_wheel_revolutions = total_energy_kj = current_mph = 0;
         last_rpm_timestamp = last_power_timestamp = 0;
         last_crank_rev_timestamp = last_wheel_rev_timestamp = 0;
+        wheel_revolution_offset = 0;
+    }
+    void set_cumulative_wheel_revolutions(const uint32_t revs) {
+        // From the SC Control Point: head unit restores its running total
+        wheel_revolution_offset = revs;
+        total_wheel_revolutions = 0.0f;
     }
     uint16_t current_watts() const {
         uint16_t watts = current_power_deciwatt / 10;
@@ -147,11 +163,23 @@ class RideStatus {
     uint16_t current_deciwatts() const {
         return current_power_deciwatt;
     }
+    uint16_t current_cadence() const {
+        return current_rpm;
+    }
+    uint16_t raw_resistance() const {
+        return current_raw_resistance;
+    }
+    uint8_t resistance() const {
+        return current_resistance;
+    }
+    uint32_t total_joules() const {
+        return (uint32_t) (total_energy_kj * 1000.0f);
+    }
     uint16_t total_kj() const {
         return (uint16_t) total_energy_kj;
     }
     uint32_t integral_wheel_revolutions() const {
-        return (uint32_t) total_wheel_revolutions;
+        return wheel_revolution_offset + (uint32_t) total_wheel_revolutions;
     }
     uint16_t integral_crank_revolutions() const {
         return (uint16_t) total_crank_revolutions;
@@ -165,19 +193,16 @@ class RideStatus {
     void update(const BikeMessage& msg, const ResistanceLUT& lut) {
         char logbuf[32];
         if (!msg.is_valid) return false;
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
-            snprintf_P(logbuf, 32, PSTR("req: %hhu\n"), msg.request);
-            logger.print(logbuf);
-        }
+        if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("req: %hhu\n", (uint8_t) msg.request);
         const unsigned long update_start = micros();
         if (msg.request == RPM) {
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) logger.print(F("Updating RPM\n"));
+            if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Updating RPM\n");
             update_new_rpm(msg.value);
        } else if (msg.request == POWER) {
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) logger.print(F("Updating power\n"));
+            if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Updating power\n");
             update_new_power(msg.value);
         } else if (msg.request == RESISTANCE) {
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) logger.print(F("Updating resistance\n"));
+            if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Updating resistance\n");
             update_new_resistance(msg.value, lut);
         } else {
             logger.print(F("DEFAULT CASE IN RIDESTATUS::UPDATE\n"));
@@ -186,15 +211,11 @@ class RideStatus {
             while(1);
         }
         const unsigned long update_end = micros();
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
-            if (msg.request == RPM) {
-                snprintf_P(logbuf, 32, PSTR("RPM upd %luus\n"), update_end-update_start);
-            } else if (msg.request == POWER) {
-                snprintf_P(logbuf, 32, PSTR("PWR upd %luus\n"), update_end-update_start);
-            } else if (msg.request == RESISTANCE) {
-                snprintf_P(logbuf, 32, PSTR("RES upd %luus\n"), update_end-update_start);
-            }
-            logger.print(logbuf);
+        if (log_enabled<LOG_LEVEL_DEBUG>()) {
+            const unsigned long update_us = update_end - update_start;
+            if (msg.request == RPM) LOGF("RPM upd %luus\n", update_us);
+            else if (msg.request == POWER) LOGF("PWR upd %luus\n", update_us);
+            else LOGF("RES upd %luus\n", update_us);
         }
     }
     void serial_status_text() const {
@@ -206,7 +227,7 @@ class RideStatus {
                    current_power_deciwatt % 10);
         dtostrf(current_mph, 4, 1, mph_str);
         dtostrf(total_energy_kj, 8, 3, kj_str);
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+        if (log_enabled<LOG_LEVEL_DEBUG>()) {
             snprintf_P(logbuf, buflen,
                                PSTR("\tRideStatus\n"
                                     "\t\trpm: %u @ lrt %lu\n"
@@ -232,7 +253,7 @@ class RideStatus {
                         wheel_str, last_wheel_rev_timestamp,
                         kj_str);
             logger.print(logbuf);
-        } else if (LOG_LEVEL >= LOG_LEVEL_INFO) {
+        } else if (log_enabled<LOG_LEVEL_INFO>()) {
             snprintf_P(logbuf, buflen,
                        PSTR("% 3urpm %smph %s %skJ\n"),
                        current_rpm, mph_str, power_str, kj_str);
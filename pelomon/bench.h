@@ -0,0 +1,158 @@
+/* On-device micro-benchmarks of the message-handling hot path, timed in
+ * CPU cycles with Timer1.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#define BENCH_ITERATIONS 32
+
+// Results go here so the compiler can't drop calls whose value is unused
+volatile uint32_t bench_sink;
+
+class BenchTimer {
+    // Timer1 runs unprescaled, so TCNT1 counts CPU cycles. Each timed call
+    // runs with interrupts off; calls over 65535 cycles are flagged.
+    private:
+    uint32_t total;
+    uint16_t best;
+    uint16_t worst;
+    uint8_t runs;
+    uint8_t sreg;
+    bool overflowed;
+
+    public:
+    static uint16_t overhead;
+
+    BenchTimer(): total(0), best(0xFFFF), worst(0), runs(0), overflowed(false) {}
+    inline void start() {
+        sreg = SREG;
+        cli();
+        TIFR1 = _BV(TOV1);
+        TCNT1 = 0;
+    }
+    inline void stop() {
+        const uint16_t elapsed = TCNT1;
+        if (TIFR1 & _BV(TOV1)) overflowed = true;
+        SREG = sreg;
+        const uint16_t cycles = elapsed > overhead ? elapsed - overhead : 0;
+        total += cycles;
+        if (cycles < best) best = cycles;
+        if (cycles > worst) worst = cycles;
+        runs++;
+    }
+    uint16_t best_cycles() const {
+        return best;
+    }
+    void print(Logger& logger, const char* label_P) const {
+        char buf[48];
+        if (overflowed) {
+            snprintf_P(buf, 48, PSTR("%S\t>65535\n"), label_P);
+        } else {
+            snprintf_P(buf, 48, PSTR("%S\t%u\t%lu\t%u\n"), label_P, best,
+                       total / runs, worst);
+        }
+        logger.print(buf);
+    }
+};
+uint16_t BenchTimer::overhead = 0;
+
+#define BENCH(label, statement) do {                        \
+        BenchTimer timer_;                                  \
+        for (uint8_t i_ = 0; i_ < BENCH_ITERATIONS; i_++) { \
+            timer_.start();                                 \
+            statement;                                      \
+            timer_.stop();                                  \
+        }                                                   \
+        timer_.print(logger, PSTR(label));                  \
+    } while (0)
+
+uint8_t bench_bike_message(uint8_t* msg, const uint8_t request,
+                           uint16_t value, const uint8_t digits) {
+    // Same encoding as the bike: ASCII digits, least significant first
+    msg[0] = 0xF1;
+    msg[1] = request;
+    msg[2] = digits;
+    for (uint8_t i = 0; i < digits; i++, value /= 10) msg[3 + i] = 0x30 + value % 10;
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < digits + 3; checksum += msg[i++]);
+    msg[digits + 3] = checksum;
+    msg[digits + 4] = 0xF6;
+    return digits + 5;
+}
+
+void run_benchmarks(Logger& logger) {
+    // Fresh state on the stack, so nothing the live ride uses is touched
+    uint8_t rpm_msg[BIKE_MSG_BUF_LEN], power_msg[BIKE_MSG_BUF_LEN],
+            resistance_msg[BIKE_MSG_BUF_LEN];
+    const uint8_t rpm_len = bench_bike_message(rpm_msg, RPM, 85, 3);
+    const uint8_t power_len = bench_bike_message(power_msg, POWER, 1875, 5);
+    const uint8_t resistance_len = bench_bike_message(resistance_msg, RESISTANCE, 650, 4);
+    const BikeMessage rpm(rpm_msg, rpm_len);
+    const BikeMessage power(power_msg, power_len);
+    const BikeMessage resistance(resistance_msg, resistance_len);
+
+    // The simulator's resistance table, so translation takes the full path
+    ResistanceLUT lut(logger);
+    lut.initialize();
+    uint16_t raw = 0;
+    for (uint8_t i = 0; i < 31; i++) {
+        raw += pgm_read_byte(RESISTANCE_LUT_DELTA_ENCODED + i);
+        lut.update_entry(raw, i);
+    }
+    RideStatus status(logger);
+    status.initialize();
+    uint8_t payload[11];
+
+    const uint8_t timsk1 = TIMSK1, tccr1a = TCCR1A, tccr1b = TCCR1B;
+    TIMSK1 = 0;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    // Calibrate out the cost of start()/stop() themselves
+    BenchTimer::overhead = 0;
+    BenchTimer empty;
+    for (uint8_t i = 0; i < 4; i++) {
+        empty.start();
+        empty.stop();
+    }
+    BenchTimer::overhead = empty.best_cycles();
+    // RideStatus::update logs at DEBUG
+    const uint8_t prev_log_level = LOG_LEVEL;
+    LOG_LEVEL = LOG_LEVEL_NONE;
+
+    char buf[32];
+    snprintf_P(buf, 32, PSTR("cycles @ %luMHz, n=%u\n"), F_CPU / 1000000UL,
+               BENCH_ITERATIONS);
+    logger.print(buf);
+    logger.println(F("func\tmin\tmean\tmax"));
+    logger.flush();
+    BENCH("valid", bench_sink = message_is_valid(power_msg, power_len));
+    BENCH("bikemsg", BikeMessage msg(power_msg, power_len); bench_sink = msg.value);
+    BENCH("rlut", bench_sink = lut.translate_raw_resistance(650));
+    BENCH("upd_rpm", status.update(rpm, lut));
+    BENCH("upd_pwr", status.update(power, lut));
+    BENCH("upd_res", status.update(resistance, lut));
+    BENCH("mph", bench_sink = (uint32_t) status.mph_from_power(1875));
+    // Payload packing only; update() also does the setChar I/O
+    const uint16_t watts = status.current_watts(), kj = status.total_kj();
+    const uint16_t crank_revs = status.integral_crank_revolutions();
+    const uint32_t wheel_revs = status.integral_wheel_revolutions();
+    const uint32_t crank_ts = status.last_crank_rev_ts_millis();
+    const uint32_t wheel_ts = status.last_wheel_rev_ts_millis();
+    BENCH("pack_cp", bench_sink = BLECyclingPower::pack_cp_measurement(
+        payload, watts, kj));
+    BENCH("pack_csc", bench_sink = BLECyclingPower::pack_csc_measurement(
+        payload, crank_revs, crank_ts, wheel_revs, wheel_ts));
+
+    LOG_LEVEL = prev_log_level;
+    TCCR1B = tccr1b;
+    TCCR1A = tccr1a;
+    TIMSK1 = timsk1;
+}
+#endif
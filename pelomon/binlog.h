@@ -0,0 +1,87 @@
+/* Deferred-format logging: hot-path log calls record the address of their
+ * PROGMEM format string plus the raw argument bytes, and the host formats
+ * them later.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef BINLOG_H
+#define BINLOG_H
+#include <util/crc16.h>
+
+/* Record layout (little-endian), decoded by tools/decode_log.py:
+ *  0  uint8   sync 0xA5
+ *  1  uint8   sync 0x5C
+ *  2  uint8   argument bytes N
+ *  3  uint16  flash address of the PROGMEM format string
+ *  5  N bytes arguments, each at its own C++ size
+ *  5+N uint16 CRC-16/XMODEM over bytes 0..4+N
+ * The format string table is the firmware image itself: the host tool
+ * reads the strings out of the build's .elf, so there is no ID list to
+ * keep in sync. Because arguments aren't promoted, each one's type must
+ * match its conversion's length modifier (hh = 1, none = 2, l = 4 bytes).
+ * Only integer conversions are supported.
+ */
+#define BINLOG_SYNC_0 0xA5
+#define BINLOG_SYNC_1 0x5C
+#define BINLOG_HEADER_LEN 5
+#define BINLOG_MAX_ARGS_LEN 16
+// Text fallback when the logger isn't in binary mode
+#define BINLOG_TEXT_BUF_LEN 48
+
+uint16_t crc16_xmodem(const uint8_t* buf, uint8_t len) {
+    uint16_t crc = 0;
+    while (len--) crc = _crc_xmodem_update(crc, *buf++);
+    return crc;
+}
+
+template <typename... Args> struct binlog_args_len;
+template <> struct binlog_args_len<> {
+    static const uint8_t value = 0;
+};
+template <typename T, typename... Args> struct binlog_args_len<T, Args...> {
+    static const uint8_t value = sizeof(T) + binlog_args_len<Args...>::value;
+};
+
+inline void binlog_pack(uint8_t*, uint8_t&) {}
+template <typename T, typename... Args>
+inline void binlog_pack(uint8_t* buf, uint8_t& base, const T& value,
+                        const Args&... args) {
+    memcpy(buf + base, &value, sizeof(T));
+    base += sizeof(T);
+    binlog_pack(buf, base, args...);
+}
+
+template <typename... Args>
+void log_deferred(Logger& logger, const char* fmt, const Args&... args) {
+    static_assert(binlog_args_len<Args...>::value <= BINLOG_MAX_ARGS_LEN,
+                  "too many LOGF argument bytes");
+    if (!logger.binary()) {
+        char buf[BINLOG_TEXT_BUF_LEN];
+        snprintf_P(buf, BINLOG_TEXT_BUF_LEN, fmt, args...);
+        logger.print(buf);
+        return;
+    }
+    uint8_t record[BINLOG_HEADER_LEN + BINLOG_MAX_ARGS_LEN + 2];
+    uint8_t base = 0;
+    record[base++] = BINLOG_SYNC_0;
+    record[base++] = BINLOG_SYNC_1;
+    record[base++] = binlog_args_len<Args...>::value;
+    const uint16_t fmt_address = (uint16_t) (uintptr_t) fmt;
+    memcpy(record + base, &fmt_address, 2);
+    base += 2;
+    binlog_pack(record, base, args...);
+    const uint16_t crc = crc16_xmodem(record, base);
+    memcpy(record + base, &crc, 2);
+    base += 2;
+    logger.write(record, base);
+}
+
+// Use in place of snprintf_P + logger.print; needs a Logger named logger
+// in scope. fmt must be a string literal.
+#define LOGF(fmt, ...) log_deferred(logger, PSTR(fmt), ##__VA_ARGS__)
+#endif
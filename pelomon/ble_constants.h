@@ -26,6 +26,7 @@
 #define SC_CONTROL_POINT_OP_START_SENSOR_CALIBRATION ((uint8_t) 2)
 #define SC_CONTROL_POINT_OP_UPDATE_SENSOR_LOCATION ((uint8_t) 3)
 #define SC_CONTROL_POINT_OP_REQUEST_SUPPORTED_SENSOR_LOCATIONS ((uint8_t) 4)
+#define SC_CONTROL_POINT_OP_RESPONSE_CODE ((uint8_t) 0x10)
 #define SC_CONTROL_POINT_RESPONSE_SUCCESS ((uint8_t) 1)
 #define SC_CONTROL_POINT_RESPONSE_OPCODE_NOT_SUPPORTED ((uint8_t) 2)
 #define SC_CONTROL_POINT_RESPONSE_INVALID_PARAMETER ((uint8_t) 3)
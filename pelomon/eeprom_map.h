@@ -18,7 +18,7 @@
  *  61: resistance value 1E, high byte
  *  62: resistance checksum, low byte
  *  63: resistance checksum, high byte
- *  64: Force Bike Simulator at Startup
+ *  64: Force Bike Simulator at Startup (FORCE_STARTUP_*)
  *  65: BLE: Cycling Power Service ID
  *  66: BLE: Cycling Power Feature GATT ID
  *  67: BLE: Cycling Power Measurement GATT ID
@@ -28,7 +28,14 @@
  *  71: BLE: Cycling Speed/Cadence Measurement GATT ID
  *  72: BLE: Cycling Speed/Cadence Sensor Location GATT ID
  *  73: BLE: Cycling Speed/Cadence Control Point GATT ID
+ *  74: BLE: GATT + advertising config fingerprint, low byte
+ *  75: BLE: GATT + advertising config fingerprint, high byte
+ *  76: BLE: Protocol health service ID (ENABLE_HEALTH_GATT only)
+ *  77: BLE: Protocol health characteristic GATT ID (ENABLE_HEALTH_GATT only)
+ *  128-1023: Ride history sample ring (see ride_history.h)
  */
+#define FORCE_STARTUP_SIMULATOR 1
+#define FORCE_STARTUP_REPLAY    2
 enum _eeprom_map {
         EEPROM_RESISTANCE_LUT_BASE_ADDRESS = 0,
         EEPROM_RESISTANCE_LUT_CHECKSUM_ADDRESS = 62,
@@ -42,6 +49,11 @@ enum _eeprom_map {
         EEPROM_BLE_CSC_MEASUREMENT_ID_ADDRESS,
         EEPROM_BLE_CSC_SENSOR_LOCATION_ID_ADDRESS,
         EEPROM_BLE_SC_CONTROL_POINT_ID_ADDRESS,
-        EEPROM_MAX_ADDRESS
+        EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS,
+        EEPROM_BLE_HEALTH_SERVICE_ID_ADDRESS = EEPROM_BLE_CONFIG_FINGERPRINT_ADDRESS + 2,
+        EEPROM_BLE_HEALTH_CHAR_ID_ADDRESS,
+        EEPROM_MAX_ADDRESS,
+        EEPROM_HISTORY_START_ADDRESS = 128,
+        EEPROM_HISTORY_END_ADDRESS = 1024
 };
 #endif
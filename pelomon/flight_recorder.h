@@ -0,0 +1,115 @@
+/* Flight recorder: the last few HU/bike message pairs, raw and complete,
+ * including invalid and timed-out ones, for reproducing field failures.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __FLIGHT_RECORDER_H__
+#define __FLIGHT_RECORDER_H__
+
+/* Entries are variable length, packed back to back in a byte ring; the
+ * oldest are evicted to make room. Entry layout (little-endian):
+ *  0  uint8   flags (FDR_*)
+ *  1  uint8   HU length << 4 | bike length
+ *  2  uint32  micros() when the pair was complete (or timed out)
+ *  6  HU bytes, then bike bytes
+ * Recording a pair is a ~25 byte copy, so this can stay on in production.
+ *
+ * The frec command dumps the ring as one frame, decoded by
+ * tools/flight_recorder.py:
+ *  0  uint8   sync 0xA5
+ *  1  uint8   sync 0x5D
+ *  2  uint8   entry count
+ *  3  uint16  bytes of entries
+ *  5  entries, oldest first
+ *  .. uint16  CRC-16/XMODEM over everything before it
+ */
+#define FDR_VALID_HU     0x01
+#define FDR_VALID_BIKE   0x02
+#define FDR_BIKE_TIMEOUT 0x04
+#define FDR_HEADER_LEN 6
+#define FDR_SYNC_0 0xA5
+#define FDR_SYNC_1 0x5D
+
+#ifdef ENABLE_FLIGHT_RECORDER
+// Exactly 256 so the uint8_t indices wrap by themselves
+const uint16_t FDR_RING_LEN = 256;
+uint8_t fdr_ring[FDR_RING_LEN];
+uint8_t fdr_head;       // next byte to write
+uint8_t fdr_tail;       // first byte of the oldest entry
+uint16_t fdr_used;
+uint8_t fdr_count;
+
+uint8_t fdr_entry_len(const uint8_t start) {
+    const uint8_t lens = fdr_ring[(uint8_t) (start + 1)];
+    return FDR_HEADER_LEN + (lens >> 4) + (lens & 0x0F);
+}
+
+void fdr_put(uint8_t const* data, uint8_t len) {
+    while (len--) fdr_ring[fdr_head++] = *data++;
+}
+
+void fdr_record(const uint8_t flags) {
+    // Clamp so the lengths always fit their nibbles
+    const uint8_t hu_len = hu_buf_bytes < HU_MSG_BUF_LEN ? hu_buf_bytes : HU_MSG_BUF_LEN;
+    const uint8_t bike_len = bike_buf_bytes < BIKE_MSG_BUF_LEN ? bike_buf_bytes : BIKE_MSG_BUF_LEN;
+    const uint8_t len = FDR_HEADER_LEN + hu_len + bike_len;
+    while (FDR_RING_LEN - fdr_used < len) {
+        const uint8_t oldest = fdr_entry_len(fdr_tail);
+        fdr_tail += oldest;     // wraps with the uint8_t index
+        fdr_used -= oldest;
+        fdr_count--;
+    }
+    const uint8_t lens = (hu_len << 4) | bike_len;
+    const unsigned long now = micros();
+    fdr_put(&flags, 1);
+    fdr_put(&lens, 1);
+    fdr_put((uint8_t const*) &now, 4);
+    fdr_put(hu_buf, hu_len);
+    fdr_put(bike_buf, bike_len);
+    fdr_used += len;
+    fdr_count++;
+}
+
+void dump_flight_recorder(Logger& logger) {
+    // Streamed in chunks so the dump doesn't need a ring-sized stack buffer
+    uint8_t chunk[32];
+    uint8_t n = 0;
+    uint16_t crc = 0;
+    chunk[n++] = FDR_SYNC_0;
+    chunk[n++] = FDR_SYNC_1;
+    chunk[n++] = fdr_count;
+    chunk[n++] = fdr_used & 0xFF;
+    chunk[n++] = fdr_used >> 8;
+    uint8_t i = fdr_tail;
+    for (uint16_t j = 0; j < fdr_used; j++) {
+        chunk[n++] = fdr_ring[i++];
+        if (n == sizeof(chunk) - 2) {   // leave room for the CRC
+            for (uint8_t k = 0; k < n; k++) crc = _crc_xmodem_update(crc, chunk[k]);
+            logger.write(chunk, n);
+            n = 0;
+        }
+    }
+    for (uint8_t k = 0; k < n; k++) crc = _crc_xmodem_update(crc, chunk[k]);
+    chunk[n++] = crc & 0xFF;
+    chunk[n++] = crc >> 8;
+    logger.write(chunk, n);
+    logger.print('\n');
+}
+
+void init_flight_recorder(void) {
+    fdr_head = fdr_tail = fdr_count = 0;
+    fdr_used = 0;
+}
+
+#else
+#define fdr_record(flags)
+#define init_flight_recorder()
+#define dump_flight_recorder(logger)
+#endif
+
+#endif
@@ -0,0 +1,106 @@
+/* Always-on latency histograms for each stage of the main loop.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __LATENCY_STATS_H__
+#define __LATENCY_STATS_H__
+
+// Bucket i > 0 holds durations in [2^(i-1), 2^i) us; the last bucket
+// takes everything from 2^(LATENCY_BUCKETS-2) us (65ms) up.
+#define LATENCY_BUCKETS 18
+
+typedef enum {
+    STAGE_RX_WAIT,      // HU request done to first bike byte
+    STAGE_HU_READ,
+    STAGE_BIKE_READ,
+    STAGE_PARSE,
+    STAGE_RIDE_UPDATE,
+    STAGE_BLE_UPDATE,
+    STAGE_LOGGING,
+    STAGE_COMMAND,
+    STAGE_COUNT
+} latency_stage_t;
+
+class LatencyHistogram {
+    private:
+    // Bucket counts are a byte each: when one would overflow, every
+    // bucket is halved, which keeps the shape of the distribution.
+    uint8_t buckets[LATENCY_BUCKETS];
+    uint16_t count_;
+    uint32_t max_us_;
+
+    public:
+    LatencyHistogram() {
+        reset();
+    }
+    void reset() {
+        memset(buckets, 0, LATENCY_BUCKETS);
+        count_ = 0;
+        max_us_ = 0;
+    }
+    void record(uint32_t us) {
+        if (us > max_us_) max_us_ = us;
+        if (count_ < 0xFFFF) count_++;
+        uint8_t bucket = 0;
+        while (us != 0 && bucket < LATENCY_BUCKETS - 1) {
+            us >>= 1;
+            bucket++;
+        }
+        if (buckets[bucket] == 0xFF) {
+            for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) buckets[i] >>= 1;
+        }
+        buckets[bucket]++;
+    }
+    uint32_t percentile(const uint8_t pct) const {
+        // Upper bound of the bucket holding the pct'th percentile
+        uint16_t total = 0;
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) total += buckets[i];
+        if (total == 0) return 0;
+        const uint32_t target = ((uint32_t) total * pct + 99) / 100;
+        uint16_t seen = 0;
+        for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += buckets[i];
+            if (seen >= target) {
+                if (i == LATENCY_BUCKETS - 1) return max_us_;
+                return ((uint32_t) 1 << i) - 1;
+            }
+        }
+        return max_us_;
+    }
+    uint16_t count() const {
+        return count_;
+    }
+    uint32_t max_us() const {
+        return max_us_;
+    }
+};
+
+class LatencyStats {
+    private:
+    LatencyHistogram stages[STAGE_COUNT];
+
+    public:
+    void record(const latency_stage_t stage, const uint32_t us) {
+        stages[stage].record(us);
+    }
+    void print_and_reset(Logger& logger) {
+        // Order matches latency_stage_t
+        static const char names[STAGE_COUNT][8] PROGMEM = {
+            "rxwait", "huread", "bkread", "parse", "ride", "ble", "log", "cmd"};
+        char buf[48];
+        logger.println(F("stage\tn\tp50_us\tp99_us\tmax_us"));
+        for (uint8_t i = 0; i < STAGE_COUNT; i++) {
+            const LatencyHistogram& h = stages[i];
+            snprintf_P(buf, 48, PSTR("%S\t%u\t%lu\t%lu\t%lu\n"), names[i],
+                       h.count(), h.percentile(50), h.percentile(99), h.max_us());
+            logger.print(buf);
+            stages[i].reset();
+        }
+    }
+};
+#endif
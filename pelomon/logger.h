@@ -15,27 +15,192 @@
 #define MIN(x,y) (x) < (y) ? (x) : (y)
 #endif
 
+// Use as if (log_enabled<LOG_LEVEL_DEBUG>()) { ... }. The compile-time
+// half folds away, so levels above LOG_LEVEL_COMPILED cost no flash or
+// branches; the runtime LOG_LEVEL check only exists for levels kept.
+template <uint8_t level>
+inline bool log_enabled() {
+    return level <= LOG_LEVEL_COMPILED && LOG_LEVEL >= level;
+}
+
+/* Log output is queued per sink and written out from poll() in slack time
+ * between Peloton frames, so a log line in the middle of message handling
+ * never waits on USB or SPI. If a sink's queue can't take a whole message
+ * it is dropped for that sink and counted, unless the logger is in
+ * blocking mode (setup and user commands), where we drain to make room.
+ * Ring sizes must be powers of two; one byte of each is unused.
+ */
+#define LOGGER_SERIAL_RING_LEN 64
+#define LOGGER_BLE_RING_LEN 128
+// BLE output goes out in writes of up to this many bytes (several full
+// SDEP packets per response read), once that much is queued...
+#define LOGGER_BLE_DRAIN_LEN (4 * SDEP_MAX_PACKETSIZE)
+// ...or nothing has been logged for this long
+#define LOGGER_BLE_IDLE_FLUSH_MILLIS 20
+// Testing Serial for a connection costs a 10ms delay() in the 32u4 core,
+// so the USB connection state is sampled from DTR at most this often
+#define LOGGER_SERIAL_CHECK_MILLIS 1000
+
+class LogRing {
+    private:
+    uint8_t* const buf;
+    const uint8_t mask;
+    uint8_t head, tail;
+
+    public:
+    uint16_t dropped_messages;
+    uint16_t dropped_bytes;
+    uint8_t high_water;
+
+    LogRing(uint8_t* buf_, const uint8_t len): buf(buf_), mask(len - 1),
+        head(0), tail(0), dropped_messages(0), dropped_bytes(0), high_water(0) {};
+    uint8_t used() const {
+        return (head - tail) & mask;
+    }
+    uint8_t space() const {
+        return mask - used();
+    }
+    uint8_t capacity() const {
+        return mask;
+    }
+    void push(uint8_t const* data, uint8_t len) {
+        while (len--) {
+            buf[head] = *data++;
+            head = (head + 1) & mask;
+        }
+        if (used() > high_water) high_water = used();
+    }
+    uint8_t pop(uint8_t* out, uint8_t len) {
+        uint8_t n = 0;
+        while (n < len && tail != head) {
+            out[n++] = buf[tail];
+            tail = (tail + 1) & mask;
+        }
+        return n;
+    }
+    void drop(const size_t len) {
+        dropped_messages++;
+        dropped_bytes += len;
+    }
+    void reset_stats() {
+        dropped_messages = dropped_bytes = 0;
+        high_water = used();
+    }
+};
 
 class Logger {
     private:
         Adafruit_BLE* ble_;
+        uint8_t serial_buf[LOGGER_SERIAL_RING_LEN];
+        uint8_t ble_buf[LOGGER_BLE_RING_LEN];
+        LogRing serial_ring;
+        LogRing ble_ring;
+        unsigned long ble_last_write;
+        unsigned long serial_last_check;
+        bool serial_connected_;
+        bool blocking;
+        bool binary_;
+
+        bool serial_connected() {
+            const unsigned long now = millis();
+            if (now - serial_last_check >= LOGGER_SERIAL_CHECK_MILLIS) {
+                serial_last_check = now;
+                serial_connected_ = Serial.dtr();
+            }
+            return serial_connected_;
+        }
+
+        void drain_serial(const bool block) {
+            uint8_t chunk[LOGGER_SERIAL_RING_LEN];
+            while (serial_ring.used() > 0) {
+                int room = block ? LOGGER_SERIAL_RING_LEN : Serial.availableForWrite();
+                if (room <= 0) return;
+                const uint8_t n = serial_ring.pop(chunk, MIN(room, LOGGER_SERIAL_RING_LEN));
+                Serial.write(chunk, n);
+            }
+        }
+        void drain_ble(const bool all) {
+            // One writeBLEUart per chunk; each costs an SDEP round trip
+            uint8_t chunk[LOGGER_BLE_DRAIN_LEN];
+            do {
+                const uint8_t n = ble_ring.pop(chunk, LOGGER_BLE_DRAIN_LEN);
+                if (n == 0) break;
+                if (ble_ != NULL) ble_->writeBLEUart(chunk, n);
+            } while (all || ble_ring.used() >= LOGGER_BLE_DRAIN_LEN);
+        }
+        void enqueue(LogRing& ring, uint8_t const* buf, const size_t len,
+                     const bool is_ble) {
+            if (len > ring.space() && blocking) {
+                if (is_ble) drain_ble(true);
+                else drain_serial(true);
+                if (len > ring.capacity()) {
+                    // Too big to ever queue; we're allowed to block anyway
+                    if (is_ble) ble_->writeBLEUart(buf, len);
+                    else Serial.write(buf, len);
+                    return;
+                }
+            }
+            if (len > ring.space()) {
+                ring.drop(len);
+                return;
+            }
+            ring.push(buf, len);
+        }
     public:
-        Logger(): ble_(NULL) {}
+        Logger(): ble_(NULL), serial_ring(serial_buf, LOGGER_SERIAL_RING_LEN),
+            ble_ring(ble_buf, LOGGER_BLE_RING_LEN), ble_last_write(0),
+            // Due for a check on the first write
+            serial_last_check(-LOGGER_SERIAL_CHECK_MILLIS),
+            serial_connected_(false), blocking(true), binary_(false) {}
         void set_ble(Adafruit_BLE* ble) {
+            drain_ble(true);
             ble_ = ble;
         }
+        void set_blocking(const bool block) {
+            // Only allow blocking when missing a Peloton frame is acceptable
+            blocking = block;
+        }
+        bool binary() const {
+            // Output is a binary stream: LOGF emits records, not text
+            return binary_;
+        }
+        void set_binary(const bool binary) {
+            binary_ = binary;
+        }
         size_t write(uint8_t const* buf, const size_t len) {
-            size_t written = 0, towrite = 0, ble_written = 0;
-            // If nonblocking, conditionally truncate writes
-            const bool nonblock = false;
-            if (Serial) {
-                towrite = nonblock ? MIN(Serial.availableForWrite(), len) : len;
-                written = Serial.write(buf, towrite);
-            }
+            if (serial_connected()) enqueue(serial_ring, buf, len, false);
             if (ble_ != NULL) {
-                ble_written = ble_->writeBLEUart(buf, len);
+                enqueue(ble_ring, buf, len, true);
+                ble_last_write = millis();
             }
-            return ble_written > written ? ble_written : written;
+            return len;
+        }
+        void flush() {
+            // Blocking: write out everything queued
+            drain_serial(true);
+            drain_ble(true);
+        }
+        void poll(const bool slack) {
+            // Call every loop(); slack is true when BLE SPI traffic can't
+            // collide with an incoming Peloton frame. USB writes only take
+            // what fits in the endpoint, so they never block.
+            if (serial_ring.used() > 0 && serial_connected()) drain_serial(false);
+            if (!slack || ble_ring.used() == 0) return;
+            if (ble_ring.used() >= LOGGER_BLE_DRAIN_LEN) drain_ble(false);
+            else if (millis() - ble_last_write >= LOGGER_BLE_IDLE_FLUSH_MILLIS) drain_ble(true);
+        }
+        void print_stats() {
+            char buf[64];
+            snprintf_P(buf, 64, PSTR("Log drops: USB %u msg %u B, BLE %u msg %u B\n"),
+                       serial_ring.dropped_messages, serial_ring.dropped_bytes,
+                       ble_ring.dropped_messages, ble_ring.dropped_bytes);
+            print(buf);
+            snprintf_P(buf, 64, PSTR("Log queue peak: USB %u/%u B, BLE %u/%u B\n"),
+                       serial_ring.high_water, serial_ring.capacity(),
+                       ble_ring.high_water, ble_ring.capacity());
+            print(buf);
+            serial_ring.reset_stats();
+            ble_ring.reset_stats();
         }
         size_t print(char c) {
             return write(&c, 1);
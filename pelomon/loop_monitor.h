@@ -0,0 +1,87 @@
+/* Main loop jitter and slack monitor: how much of each Peloton request
+ * cycle is actually free for everything else the firmware does.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __LOOP_MONITOR_H__
+#define __LOOP_MONITOR_H__
+
+// An iteration shorter than this found nothing to do: it only polled
+#define LOOP_IDLE_MAX_US 200
+
+class LoopMonitor {
+    private:
+    LatencyHistogram iteration;     // loop() duration
+    LatencyHistogram slack;         // last busy iteration end to next HU byte
+    uint32_t max_period_us;
+    uint32_t min_slack_us;
+    uint32_t busy_us;
+    unsigned long iteration_start;
+    unsigned long last_busy_end;
+    unsigned long window_start;
+    bool busy_since_frame;
+
+    public:
+    LoopMonitor(): max_period_us(0), min_slack_us(0xFFFFFFFF), busy_us(0),
+        iteration_start(0), last_busy_end(0), window_start(0),
+        busy_since_frame(false) {}
+
+    void begin_iteration(const unsigned long now) {
+        if (iteration_start != 0 && now - iteration_start > max_period_us) {
+            max_period_us = now - iteration_start;
+        }
+        if (window_start == 0) window_start = now;
+        iteration_start = now;
+    }
+    void end_iteration(const unsigned long now) {
+        const uint32_t duration = now - iteration_start;
+        iteration.record(duration);
+        if (duration > LOOP_IDLE_MAX_US) {
+            busy_us += duration;
+            last_busy_end = now;
+            busy_since_frame = true;
+        }
+    }
+    void hu_frame_started(const unsigned long now) {
+        // Slack is only meaningful if some work has finished since the
+        // previous frame; back-to-back frames during boot don't count.
+        if (busy_since_frame) {
+            const uint32_t free_us = now - last_busy_end;
+            slack.record(free_us);
+            if (free_us < min_slack_us) min_slack_us = free_us;
+        }
+        busy_since_frame = false;
+    }
+    void print_and_reset(Logger& logger, const unsigned long now) {
+        char buf[48];
+        const uint32_t elapsed = now - window_start;
+        const uint32_t busy_pct = busy_us / (elapsed / 100 + 1);
+        snprintf_P(buf, 48, PSTR("Loops %u, busy %lu%% of %lums\n"),
+                   iteration.count(), busy_pct, elapsed / 1000);
+        logger.print(buf);
+        snprintf_P(buf, 48, PSTR("Iter us p50 %lu p99 %lu max %lu\n"),
+                   iteration.percentile(50), iteration.percentile(99),
+                   iteration.max_us());
+        logger.print(buf);
+        snprintf_P(buf, 48, PSTR("Max period %luus\n"), max_period_us);
+        logger.print(buf);
+        if (slack.count() == 0) {
+            logger.println(F("Slack: no frames"));
+        } else {
+            snprintf_P(buf, 48, PSTR("Slack us min %lu p1 %lu p50 %lu\n"),
+                       min_slack_us, slack.percentile(1), slack.percentile(50));
+            logger.print(buf);
+        }
+        iteration.reset();
+        slack.reset();
+        max_period_us = busy_us = 0;
+        min_slack_us = 0xFFFFFFFF;
+        window_start = now;
+    }
+};
+#endif
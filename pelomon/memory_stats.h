@@ -0,0 +1,104 @@
+/* SRAM usage: static data size, heap, and the stack's high-water mark.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __MEMORY_STATS_H__
+#define __MEMORY_STATS_H__
+
+/* SRAM layout on the 32u4 (2.5KB):
+ *   RAMSTART  .data, .bss (globals)      up to _end / __heap_start
+ *             heap (malloc), if used     up to __brkval
+ *             free
+ *   RAMEND    stack, growing down        from __stack
+ * Before main() runs, everything between _end and the top of the stack is
+ * painted with STACK_CANARY. The lowest byte the stack has overwritten
+ * since then is its high-water mark. tools/mem_report.py gives the
+ * per-symbol breakdown of the static part from the .elf.
+ */
+#define STACK_CANARY 0xC5
+
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char* __brkval;
+extern char __heap_start;
+
+// Runs in .init1, before the C runtime has set up the zero register, so
+// it can't be written in C
+void paint_stack(void) __attribute__ ((naked, used, section(".init1")));
+void paint_stack(void) {
+    __asm volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (STACK_CANARY));
+}
+
+uint16_t mem_static_bytes(void) {
+    return (uint16_t) &_end - RAMSTART;
+}
+
+uint8_t* mem_heap_end(void) {
+    return (uint8_t*) (__brkval != NULL ? __brkval : &__heap_start);
+}
+
+uint16_t mem_free_now(void) {
+    // Distance from the top of the heap to the current stack pointer
+    uint8_t here;
+    return &here - mem_heap_end();
+}
+
+uint16_t mem_stack_free_min(void) {
+    // Painted bytes still intact above the heap. Scanning is O(free RAM),
+    // a few hundred microseconds at most.
+    uint8_t const* p = mem_heap_end();
+    while (p <= &__stack && *p == STACK_CANARY) p++;
+    return p - mem_heap_end();
+}
+
+uint16_t mem_stack_peak(void) {
+    const uint16_t deepest = (uint16_t) (mem_heap_end() + mem_stack_free_min());
+    return RAMEND + 1 - deepest;
+}
+
+// Set once the high-water mark gets within STACK_LOW_WATER_BYTES of the
+// heap; checked from the main loop every STACK_CHECK_INTERVAL_MILLIS
+bool mem_low_water_warned = false;
+unsigned long mem_last_check = 0;
+
+void check_stack(Logger& logger, const unsigned long now) {
+    if (mem_low_water_warned ||
+        now - mem_last_check < STACK_CHECK_INTERVAL_MILLIS) return;
+    mem_last_check = now;
+    const uint16_t free_min = mem_stack_free_min();
+    if (free_min < STACK_LOW_WATER_BYTES) {
+        mem_low_water_warned = true;
+        char buf[48];
+        snprintf_P(buf, 48, PSTR("WARNING: stack came within %uB of heap\n"),
+                   free_min);
+        logger.print(buf);
+    }
+}
+
+void print_memory_stats(Logger& logger) {
+    char buf[48];
+    const uint16_t heap = mem_heap_end() - (uint8_t*) &__heap_start;
+    snprintf_P(buf, 48, PSTR("SRAM %u B: static %u, heap %u\n"),
+               RAMEND - RAMSTART + 1, mem_static_bytes(), heap);
+    logger.print(buf);
+    snprintf_P(buf, 48, PSTR("Stack peak %u B, free now %u min %u\n"),
+               mem_stack_peak(), mem_free_now(), mem_stack_free_min());
+    logger.print(buf);
+}
+#endif
@@ -23,10 +23,23 @@
 uint8_t LOG_LEVEL;
 
 #include "logger.h"
+#include "binlog.h"
+#define ENABLE_TRACE
+#include "trace.h"
+// Serve the protocol health block as a custom GATT characteristic. Off by
+// default: changing the GATT table costs one module factory reset.
+// #define ENABLE_HEALTH_GATT
 #include "BLECyclingGatt.h"
 #include "resistance_lut.h"
 #include "peloton.h"
 #include "RideStatus.h"
+#include "update_scheduler.h"
+#include "telemetry.h"
+#include "ride_history.h"
+#include "latency_stats.h"
+#include "loop_monitor.h"
+#include "protocol_health.h"
+#include "memory_stats.h"
 
 #ifndef MIN
 #define MIN(x,y) (x) < (y) ? (x) : (y)
@@ -47,18 +60,22 @@ void serial_log_messagepair_text(void);
  * note - log level global is at top of sketch
  */
 
-#define HU_MSG_BUF_LEN 4
-#define BIKE_MSG_BUF_LEN 15
-
 uint8_t hu_buf[HU_MSG_BUF_LEN];
 uint8_t bike_buf[BIKE_MSG_BUF_LEN];
 uint8_t hu_buf_bytes;
 uint8_t bike_buf_bytes;
 uint8_t running_checksum;
-unsigned long last_status_sent;
 unsigned long last_time_messages_seen;
 bool boot_sequence_complete;
 
+// BLE UART commands are assembled here by the UART RX event callback,
+// which runs inside ble.update(); read_BLE_command() just hands over a
+// completed line.
+#define CMD_BUF_LEN 32
+char ble_cmd_buf[CMD_BUF_LEN];
+uint8_t ble_cmd_len;
+bool ble_cmd_ready;
+
 // Set up an ISR on an arbitrary point in timer0 which ticks
 // over at about 1KHz. Use this to time-limit our wait for
 // bike responses and ensure user responsiveness.
@@ -82,11 +99,21 @@ Adafruit_BluefruitLE_SPI ble(BLUEFRUIT_SPI_CS, BLUEFRUIT_SPI_IRQ, BLUEFRUIT_SPI_
 BLECyclingPower power_service(ble, logger);
 RideStatus ride_status(logger);
 ResistanceLUT resistance_lut(logger);
-
-#define ENABLE_RINGBUF
-#include "ringbuf.h"
+UpdateScheduler ble_scheduler;
+Telemetry telemetry(logger);
+RideHistory ride_history;
+HistoryTransfer history_transfer(ble, logger, ride_history);
+LatencyStats latency_stats;
+LoopMonitor loop_monitor;
+ProtocolHealth protocol_health;
+
+#define ENABLE_FLIGHT_RECORDER
+#include "flight_recorder.h"
+#include "bench.h"
 
 void reboot(void) {
+    // Get any buffered log output out before going down
+    logger.flush();
     // Reset board using the watchdog timer
     wdt_disable();
     wdt_enable(WDTO_15MS);
@@ -111,6 +138,7 @@ void setup() {
     digitalWrite(PIN_STATE_HANDLE_CMD, LOW);
     digitalWrite(PIN_STATE_LISTEN_HU, LOW);
     digitalWrite(PIN_STATE_LISTEN_BIKE, LOW);
+    init_trace();
 
     // Set LED high while initializing
     digitalWrite(LED_BUILTIN, HIGH);
@@ -120,21 +148,16 @@ void setup() {
 
     // Initialize serial ports
     Serial.begin(230400); // Communicate with PC, if exists, at 230.4kbps
-    // Give Serial three seconds to connect then charge ahead
-    delay(3000);
+    // Don't wait for Serial to connect: logger skips it until it does.
 
     logger.println(F("Initializing BLE module..."));
-    // Initialize BLE module
-    const bool ble_verbose = LOG_LEVEL > LOG_LEVEL_INFO;
-    if ( !ble.begin(ble_verbose) ) {
+    // Initialize BLE module. Don't block for its reboot here; overlap it
+    // with the rest of setup and wait out whatever remains afterwards.
+    const bool ble_verbose = log_enabled<LOG_LEVEL_DEBUG>();
+    if ( !ble.begin(ble_verbose, false) ) {
         logger.println(F("BLE init failed"));
         while (1);
     }
-    ble.echo(false);
-
-    logger.set_ble(&ble);
-
-    logger.println(F("Communications initialized"));
 
     // Initialize buffers and state
     memset(hu_buf, 0, HU_MSG_BUF_LEN);
@@ -142,29 +165,48 @@ void setup() {
     hu_buf_bytes = bike_buf_bytes = running_checksum = 0;
     last_time_messages_seen = 0;
     boot_sequence_complete = false;
-    init_ringbuf();
+    init_flight_recorder();
 
     resistance_lut.initialize();
     ride_status.initialize();
+    ride_history.initialize();
 
     // Decide whether to use real bike or simulator
     // Simulate if requested in software or forced in hardware.
-    bool use_simulator = (EEPROM.read(EEPROM_FORCE_SIMULATION_AT_STARTUP)
+    const uint8_t forced_mode = EEPROM.read(EEPROM_FORCE_SIMULATION_AT_STARTUP);
+    const bool use_replay = (forced_mode == FORCE_STARTUP_REPLAY);
+    bool use_simulator = (forced_mode
                           || (digitalRead(PIN_LOW_FORCE_SIM) == LOW)
                           || 0);
     // Clear the force flag for next bootup
     if (use_simulator) EEPROM.update(EEPROM_FORCE_SIMULATION_AT_STARTUP,
                                      false);
 
-    if (LOG_LEVEL >= LOG_LEVEL_INFO) {
-        if (use_simulator) logger.println(F("Simulator requested, using sim"));
+    if (log_enabled<LOG_LEVEL_INFO>()) {
+        if (use_replay) logger.println(F("Replay requested, reading bytes from USB"));
+        else if (use_simulator) logger.println(F("Simulator requested, using sim"));
     }
-    peloton.initialize(use_simulator);
+    peloton.initialize(use_simulator, use_replay);
+
+    // Finish bringing up BLE now that the module has had time to reboot
+    while (!ble.resetCompleted());
+    ble.echo(false);
+    logger.set_ble(&ble);
+    logger.println(F("Communications initialized"));
 
     power_service.initialize();
 
+    // Register after power_service, which may reset the module
+    ble_cmd_len = 0;
+    ble_cmd_ready = false;
+    ble.setBleUartRxCallback(ble_uart_rx_callback);
+
     // Initialize state machine
-    last_status_sent = millis() - BT_UPDATE_INTERVAL_MILLIS;
+    ble_scheduler.initialize();
+
+    // From here on, log output waits for slack time between frames
+    logger.flush();
+    logger.set_blocking(false);
 
     // Set LED low once bootup is complete
     digitalWrite(LED_BUILTIN, LOW);
@@ -172,38 +214,34 @@ void setup() {
 
 bool receive_message_pair(void) {
     bool hu_message_complete = false, bike_message_complete = false;
-    digitalWrite(PIN_STATE_READ_HU, HIGH);
+    TRACE_PIN(PIN_STATE_READ_HU, HIGH);
     peloton.hu_listen();
     if (peloton.hu_available() == 0) {
-        digitalWrite(PIN_STATE_READ_HU, LOW);
+        TRACE_PIN(PIN_STATE_READ_HU, LOW);
         return hu_message_complete && bike_message_complete;
     }
 
     // Read HU message
     unsigned long receive_start;
+    const unsigned long hu_start = micros();
     while (peloton.hu_available()) {
         receive_start = millis();
-        uint8_t next_byte = peloton.hu_read();
-        if (next_byte == 0xFE || next_byte == 0xF5 || next_byte == 0xF7 ||
-            hu_buf_bytes > (HU_MSG_BUF_LEN - 1)) {
-            // Reset - starting a new message, or overflow
-            // if this byte isn't the checksum
-            if (next_byte != running_checksum)
-                hu_buf_bytes = 0;
-        }
-        hu_buf[hu_buf_bytes++] = (uint8_t) next_byte;
-        running_checksum += next_byte;
-
-        if (next_byte == 0xF6) {
-            // End message
+        const uint8_t framing = frame_hu_byte(peloton.hu_read(), hu_buf,
+                                              hu_buf_bytes, running_checksum);
+        // Only a header byte marks the end of the slack before a frame;
+        // the rest of a split frame arrives on a later pass.
+        if (framing & FRAME_STARTED) loop_monitor.hu_frame_started(micros());
+        if (framing & FRAME_COMPLETE) {
             peloton.bike_listen();
-            digitalWrite(PIN_STATE_READ_HU, LOW);
-            digitalWrite(PIN_STATE_READ_BIKE, HIGH);
-            running_checksum = 0;
+            TRACE_PIN(PIN_STATE_READ_HU, LOW);
+            TRACE_PIN(PIN_STATE_READ_BIKE, HIGH);
             hu_message_complete = true;
             break;
         }
     }
+    const unsigned long hu_end = micros();
+    if (hu_message_complete) latency_stats.record(STAGE_HU_READ, hu_end - hu_start);
+    unsigned long bike_start = 0;
 
     // Read bike message with no interruptions since HU completion
     // Enable timeout timer
@@ -216,27 +254,27 @@ bool receive_message_pair(void) {
             // If we have waited too long for the bike to respond, bail.
             if (bike_wait_ms_remaining == 0) {
                 disable_bike_timeout();
+                // With only part of a HU frame we never listened to the
+                // bike; the rest of the frame arrives on a later pass.
+                if (hu_message_complete) {
+                    fdr_record(FDR_BIKE_TIMEOUT);
+                    protocol_health.record_bike_timeout(hu_buf, hu_buf_bytes);
+                }
                 return false;
             }
         }
-        uint8_t next_byte = peloton.bike_read();
-
-        if (next_byte == 0xF1 ||
-            bike_buf_bytes > (BIKE_MSG_BUF_LEN - 1)) {
-            // Reset - starting a new message; or overflow
-            // as long as this byte isn't the checksum
-            if (next_byte != running_checksum)
-                bike_buf_bytes = 0;
+        const uint8_t next_byte = peloton.bike_read();
+        if (bike_start == 0) {
+            bike_start = micros();
+            latency_stats.record(STAGE_RX_WAIT, bike_start - hu_end);
         }
-        bike_buf[bike_buf_bytes++] = (uint8_t) next_byte;
-        running_checksum += next_byte;
 
-        if (next_byte == 0xF6) {
-            // End message
+        if (frame_bike_byte(next_byte, bike_buf, bike_buf_bytes,
+                            running_checksum) & FRAME_COMPLETE) {
             peloton.hu_listen();
-            digitalWrite(PIN_STATE_READ_BIKE, LOW);
-            running_checksum = 0;
+            TRACE_PIN(PIN_STATE_READ_BIKE, LOW);
             bike_message_complete = true;
+            latency_stats.record(STAGE_BIKE_READ, micros() - bike_start);
         }
     }
     disable_bike_timeout();
@@ -246,8 +284,7 @@ bool receive_message_pair(void) {
 
 // Returns true if the message seen indicates that the bootup sequence is done.
 bool process_message_pair(void) {
-    digitalWrite(PIN_STATE_PROC_MSG, HIGH);
-    char logbuf[32];
+    TRACE_PIN(PIN_STATE_PROC_MSG, HIGH);
     const unsigned long process_start = micros();
     bool updated_ride_status = false;
     bool done_with_boot = false;
@@ -255,19 +292,19 @@ bool process_message_pair(void) {
     // Parse messages in the buffers
     HUMessage hu_msg(hu_buf, hu_buf_bytes);
     BikeMessage bike_msg(bike_buf, bike_buf_bytes);
-
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
-        snprintf_P(logbuf, 32,
-                   PSTR("hu valid:%hhu,bike valid:%hhu\n"),
-                   (uint8_t) hu_msg.is_valid,
-                   (uint8_t) bike_msg.is_valid);
-        logger.print(logbuf);
+    latency_stats.record(STAGE_PARSE, micros() - process_start);
+    protocol_health.record_pair(hu_msg, bike_msg, millis());
+    fdr_record((hu_msg.is_valid ? FDR_VALID_HU : 0) |
+               (bike_msg.is_valid ? FDR_VALID_BIKE : 0));
+
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
+        LOGF("hu valid:%hhu,bike valid:%hhu\n",
+             (uint8_t) hu_msg.is_valid, (uint8_t) bike_msg.is_valid);
         serial_log_messagepair_text();
     }
 
     if (hu_msg.is_valid && bike_msg.is_valid) {
         if (hu_msg.packet_type == READ_RESISTANCE_TABLE) {
-            add_ringbuf();
             resistance_lut.update_entry(bike_msg.value, hu_msg.request);
             // Sync to EEPROM once we get all the resistance values
             if (hu_msg.request == 0x1E) {
@@ -280,58 +317,62 @@ bool process_message_pair(void) {
         } else if (bike_msg.request == BIKE_ID ||
                    hu_msg.packet_type == STARTUP_UNKNOWN) {
             // Do nothing on the two startup packets
-            add_ringbuf();
 
         } else {
             // Update internal ride status state
+            const unsigned long update_start = micros();
             ride_status.update(bike_msg, resistance_lut);
+            latency_stats.record(STAGE_RIDE_UPDATE, micros() - update_start);
+            ble_scheduler.note_bike_message(bike_msg.request);
             updated_ride_status = true;
             done_with_boot = true;
         }
-    } else {
-        add_ringbuf();
     }
 
     // Update BLE gadget state
     // Takes 24us + time to update GATTs = 15ms
     const unsigned long bt_start = micros();
     const unsigned long current_time = millis();
-    if (current_time - last_status_sent >= BT_UPDATE_INTERVAL_MILLIS) {
-        last_status_sent = current_time;
+    if (ble_scheduler.update_due(current_time)) {
+        ble_scheduler.mark_updated(current_time);
         power_service.update(ride_status.integral_crank_revolutions(),
                              ride_status.last_crank_rev_ts_millis(),
                              ride_status.integral_wheel_revolutions(),
                              ride_status.last_wheel_rev_ts_millis(),
                              ride_status.current_watts(),
                              ride_status.total_kj());
+        if (peloton.replaying()) telemetry.send_gatt_trace(ride_status, current_time);
     }
+    ride_history.record(current_time, ride_status.current_watts(),
+                        ride_status.current_cadence(),
+                        ride_status.resistance());
 
     const unsigned long process_end = micros();
-    unsigned long log_end;
+    latency_stats.record(STAGE_BLE_UPDATE, process_end - bt_start);
 
-    if (LOG_LEVEL >= LOG_LEVEL_INFO && updated_ride_status) {
+    if (telemetry.enabled() && updated_ride_status) {
+        telemetry.send(ride_status);
+    } else if (log_enabled<LOG_LEVEL_INFO>() && updated_ride_status) {
         // this call takes about 11ms in non DEBUG mode if only one print call
         serial_print_state();
     }
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
-        snprintf_P(logbuf, 32, PSTR("proc %luus BT %luus\n"),
-                   process_end-process_start, process_end-bt_start);
-        logger.print(logbuf);
-        log_end = micros();
-        snprintf_P(logbuf,32,PSTR("logs %luus\n"), log_end - process_end);
-        logger.print(logbuf);
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
+        LOGF("proc %luus BT %luus\n",
+             process_end - process_start, process_end - bt_start);
     }
+    latency_stats.record(STAGE_LOGGING, micros() - process_end);
 
     // Reset buffers
     memset(hu_buf, 0, HU_MSG_BUF_LEN);
     memset(bike_buf, 0, BIKE_MSG_BUF_LEN);
     running_checksum = 0;
     hu_buf_bytes = bike_buf_bytes = 0;
-    digitalWrite(PIN_STATE_PROC_MSG, LOW);
+    TRACE_PIN(PIN_STATE_PROC_MSG, LOW);
     return done_with_boot;
 }
 
 void loop() {
+    loop_monitor.begin_iteration(micros());
     bool messages_available = receive_message_pair();
     if (messages_available) {
         last_time_messages_seen = millis();
@@ -350,50 +391,113 @@ void loop() {
         || (millis() - last_time_messages_seen < 100 && last_time_messages_seen != 0));
 
     if (ok_to_process_commands) {
-        digitalWrite(PIN_STATE_HANDLE_CMD, HIGH);
+        TRACE_PIN(PIN_STATE_HANDLE_CMD, HIGH);
         handle_user_command_if_available();
-        digitalWrite(PIN_STATE_HANDLE_CMD, LOW);
+        TRACE_PIN(PIN_STATE_HANDLE_CMD, LOW);
     }
+
+    // Service BLE GATT writes only right after a message pair, when the
+    // next HU request is furthest away, or when the bike has gone quiet.
+    const unsigned long since_messages = millis() - last_time_messages_seen;
+    bool ok_to_poll_ble = (
+        last_time_messages_seen == 0
+        || since_messages < BLE_EVENT_POLL_WINDOW_MILLIS
+        || since_messages >= BLE_EVENT_POLL_IDLE_MILLIS);
+    if (ok_to_poll_ble) {
+        // Cheap unless the poll interval has elapsed; each poll is one
+        // AT+EVENTSTATUS plus reads for whatever events are pending.
+        ble.update(BLE_EVENT_POLL_INTERVAL_MILLIS);
+        power_service.handle_sc_control_point();
+        uint32_t cumulative_wheel_revs;
+        if (power_service.cumulative_value_requested(cumulative_wheel_revs)) {
+            ride_status.set_cumulative_wheel_revolutions(cumulative_wheel_revs);
+        }
+        history_transfer.service();
+        check_stack(logger, millis());
+        #ifdef ENABLE_HEALTH_GATT
+        // Here rather than after a pair so it stays fresh if the bike stops
+        const unsigned long now = millis();
+        if (power_service.health_update_due(now)) {
+            uint8_t block[HEALTH_BLOCK_LEN];
+            power_service.update_health(block, protocol_health.pack(block, now), now);
+        }
+        #endif
+    }
+
+    logger.poll(ok_to_poll_ble);
+    loop_monitor.end_iteration(micros());
     return;
 }
 
 void serial_print_state(void) {
     ride_status.serial_status_text();
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+    if (log_enabled<LOG_LEVEL_DEBUG>()) {
         resistance_lut.serial_status_text();
         power_service.serial_status_text();
     }
 }
 
+void serial_print_ble_perf(void) {
+    // Order matches the BLE_PERF_* enum in Adafruit_ATParser.h
+    static const char names[BLE_PERF_COUNT][8] PROGMEM = {
+        "atcmd", "waitok", "readln", "sdeptx", "sdeprx", "uarttx"};
+    const blePerfStat_t* stats = ble.perfStats();
+    if (stats == NULL) {
+        logger.println(F("BLE_PERF disabled"));
+        return;
+    }
+    char buf[48];
+    logger.println(F("op\tn\ttot_us\tmax_us"));
+    for (uint8_t i = 0; i < BLE_PERF_COUNT; i++) {
+        snprintf_P(buf, 48, PSTR("%S\t%lu\t%lu\t%lu\n"), names[i],
+                   stats[i].count, stats[i].total_us, stats[i].max_us);
+        logger.print(buf);
+    }
+    ble.perfReset();
+}
+
 void handle_user_command_if_available() {
-    const uint8_t buflen = 32;
+    const uint8_t buflen = CMD_BUF_LEN;
     char cmdbuf[buflen];
+    // In replay mode USB serial carries the replayed messages instead
     bool command_available = (read_BLE_command(cmdbuf, buflen) ||
-                              read_serial_command(cmdbuf, buflen));
-    if (command_available) run_command(cmdbuf);
+                              (!peloton.replaying() &&
+                               read_serial_command(cmdbuf, buflen)));
+    if (command_available) {
+        // Commands may print a lot; let the logger block rather than drop
+        const unsigned long command_start = micros();
+        logger.set_blocking(true);
+        run_command(cmdbuf);
+        logger.flush();
+        logger.set_blocking(false);
+        latency_stats.record(STAGE_COMMAND, micros() - command_start);
+    }
 }
 
-bool read_BLE_command(char *cmdbuf, const uint8_t buflen) {
-    const unsigned long prev_timeout = ble.getTimeout();
-    char* res = NULL;
-    int rxlen;
-
-    // Wait no more than 3ms for data to come in.
-    // At 1ms, reception is unreliable. Allow a little buffer.
-    // (For the same reason, available() on the BLEUart isn't great.)
-    ble.setTimeout(3);
-
-    while (NULL == res) {
-        rxlen = ble.readBLEUart(cmdbuf, buflen);
-        if (rxlen == 0) break;
-        res = memchr(cmdbuf, '\n', buflen);
+void ble_uart_rx_callback(char data[], uint16_t len) {
+    if (history_transfer.active()) {
+        history_transfer.handle_rx(data, len);
+        return;
     }
-    // Restore previous timeout setting
-    ble.setTimeout(prev_timeout);
-    if (rxlen == 0 && NULL == res) return false;
-    // Null terminate at newline
-    *res = '\0';
-    logger.println(res);
+    // Keep only the first line until it has been consumed
+    for (uint16_t i = 0; i < len && !ble_cmd_ready; i++) {
+        if (data[i] == '\n') {
+            ble_cmd_buf[ble_cmd_len] = '\0';
+            ble_cmd_ready = true;
+        } else if (data[i] != '\r' && ble_cmd_len < CMD_BUF_LEN - 1) {
+            ble_cmd_buf[ble_cmd_len++] = data[i];
+        }
+    }
+}
+
+bool read_BLE_command(char *cmdbuf, const uint8_t buflen) {
+    // No SPI traffic here: the UART RX event fills ble_cmd_buf
+    if (!ble_cmd_ready) return false;
+    strncpy(cmdbuf, ble_cmd_buf, buflen);
+    cmdbuf[buflen - 1] = '\0';
+    ble_cmd_len = 0;
+    ble_cmd_ready = false;
+    logger.println(cmdbuf);
     return true;
 }
 
@@ -421,6 +525,7 @@ void run_command(const char* const cmdbuf) {
             "COMMANDS:\n"
             "\thelp\tlist commands\n"
             "\tsim\treboot to simulator\n"
+            "\treplay\treboot to replay a capture from USB\n"
             "\treboot\treboot\n"
             "\tfreset\tfactory reset\n"
             "\tnolog\tdisable logging\n"
@@ -428,20 +533,39 @@ void run_command(const char* const cmdbuf) {
             "\tdebug\t log level DEBUG\n"
             "\trlut\tdump resistance LUT\n"
             "\tble\tdump BLE module state\n"
+            "\tbleperf\tdump+reset BLE latency stats\n"
+            "\tlogstat\tdump+reset log drop counters\n"
+            "\tstats\tdump+reset loop stage latencies\n"
+            "\tloop\tdump+reset loop jitter and slack\n"
+            "\thealth\tdump protocol health counters\n"
+            "\tmem\tdump SRAM and stack usage\n"
+            "\tbench\ttime hot functions in CPU cycles\n"
+            #ifdef ENABLE_TRACE
+            "\ttrace\tdump+clear loop timeline trace\n"
+            #endif
             "\tride\tdump ride state\n"
-            #ifdef ENABLE_RINGBUF
-            "\tring\tdump bootup ring buffer\n"
+            "\ttelem\ttoggle binary telemetry\n"
+            "\thist\tsend ride history over BLE UART\n"
+            #ifdef ENABLE_FLIGHT_RECORDER
+            "\tfrec\tdump recent raw message pairs\n"
             #endif
         ));
     }
     //  SWITCH TO SIMULATOR
     else if (strncmp_P(cmdbuf,PSTR("sim"),3) == 0) {
         logger.println(F("Rebooting to sim..."));
-        EEPROM.write(EEPROM_FORCE_SIMULATION_AT_STARTUP, true);
+        EEPROM.write(EEPROM_FORCE_SIMULATION_AT_STARTUP, FORCE_STARTUP_SIMULATOR);
+        reboot();
+    }
+    //  SWITCH TO REPLAY OF A CAPTURE FROM tools/replay.py
+    else if (strncmp_P(cmdbuf, PSTR("replay"), 6) == 0) {
+        logger.println(F("Rebooting to replay..."));
+        EEPROM.write(EEPROM_FORCE_SIMULATION_AT_STARTUP, FORCE_STARTUP_REPLAY);
         reboot();
     }
     else if (strncmp_P(cmdbuf, PSTR("freset"), 6) == 0) {
         for (int i=0; i < EEPROM_MAX_ADDRESS; EEPROM.update(i++,0));
+        ride_history.clear();
         ble.factoryReset();
         reboot();
     }
@@ -453,6 +577,9 @@ void run_command(const char* const cmdbuf) {
         logger.println(F("Logs->INFO"));
         LOG_LEVEL = LOG_LEVEL_INFO;
     } else if (strncmp_P(cmdbuf,PSTR("debug"),5) == 0) {
+        if (LOG_LEVEL_COMPILED < LOG_LEVEL_DEBUG) {
+            logger.println(F("DEBUG logs not compiled in"));
+        }
         logger.println(F("Logs->DEBUG"));
         LOG_LEVEL = LOG_LEVEL_DEBUG;
     } else if (strncmp_P(cmdbuf,PSTR("nolog"),5) == 0) {
@@ -464,18 +591,45 @@ void run_command(const char* const cmdbuf) {
         LOG_LEVEL = LOG_LEVEL_MAX;
         resistance_lut.serial_status_text();
         LOG_LEVEL = prev_log_level;
+    } else if (strncmp_P(cmdbuf, PSTR("bleperf"), 7) == 0) {
+        serial_print_ble_perf();
     } else if (strncmp_P(cmdbuf, PSTR("ble"), 3) == 0) {
         LOG_LEVEL = LOG_LEVEL_MAX;
         power_service.serial_status_text();
         LOG_LEVEL = prev_log_level;
+    } else if (strncmp_P(cmdbuf, PSTR("logstat"), 7) == 0) {
+        logger.print_stats();
+    } else if (strncmp_P(cmdbuf, PSTR("stats"), 5) == 0) {
+        latency_stats.print_and_reset(logger);
+    } else if (strncmp_P(cmdbuf, PSTR("loop"), 4) == 0) {
+        loop_monitor.print_and_reset(logger, micros());
+    } else if (strncmp_P(cmdbuf, PSTR("health"), 6) == 0) {
+        protocol_health.print(logger, millis());
+    } else if (strncmp_P(cmdbuf, PSTR("mem"), 3) == 0) {
+        print_memory_stats(logger);
+    } else if (strncmp_P(cmdbuf, PSTR("bench"), 5) == 0) {
+        run_benchmarks(logger);
     } else if (strncmp_P(cmdbuf, PSTR("ride"), 4) == 0) {
         LOG_LEVEL = LOG_LEVEL_MAX;
         ride_status.serial_status_text();
         LOG_LEVEL = prev_log_level;
+    } else if (strncmp_P(cmdbuf, PSTR("telem"), 5) == 0) {
+        telemetry.set_enabled(!telemetry.enabled());
+        logger.set_binary(telemetry.enabled());
+        if (telemetry.enabled()) logger.println(F("Telemetry->BINARY"));
+        else logger.println(F("Telemetry->TEXT"));
+    } else if (strncmp_P(cmdbuf, PSTR("hist"), 4) == 0) {
+        // Binary frames, for tools/fetch_history.py; see ride_history.h
+        history_transfer.start();
     }
-    #ifdef ENABLE_RINGBUF
-    else if (strncmp_P(cmdbuf, PSTR("ring"), 4) == 0) {
-            dump_ringbuf();
+    #ifdef ENABLE_TRACE
+    else if (strncmp_P(cmdbuf, PSTR("trace"), 5) == 0) {
+        dump_trace(logger);
+    }
+    #endif
+    #ifdef ENABLE_FLIGHT_RECORDER
+    else if (strncmp_P(cmdbuf, PSTR("frec"), 4) == 0) {
+        dump_flight_recorder(logger);
     }
     #endif
 
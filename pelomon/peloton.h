@@ -11,13 +11,35 @@
 #ifndef _PELOTON_H_
 #define _PELOTON_H_
 #include <SoftwareSerial.h>
-bool message_is_valid(uint8_t* msg, uint8_t len);
-bool message_is_valid(uint8_t* msg, uint8_t len) {
+// Why a message was rejected, for the protocol health counters
+typedef enum {
+    MSG_OK = 0,
+    MSG_BAD_TERMINATOR,
+    MSG_BAD_HEADER,
+    MSG_BAD_LENGTH,
+    MSG_BAD_CHECKSUM,
+    MSG_WRONG_SOURCE,       // well-formed, but from the other end of the link
+    MSG_DIGIT_OVERFLOW,     // bike value doesn't fit in 16 bits
+    MSG_BAD_DIGIT,          // bike payload byte isn't an ASCII digit
+    MSG_STATUS_COUNT
+} msg_status_t;
+
+// Defined in the sketch; parse errors go through its queue rather than
+// blocking on Serial in the middle of a frame
+extern Logger logger;
+
+msg_status_t message_status(uint8_t* msg, uint8_t len) {
+    // Shortest message is the 4-byte HU request; anything shorter would
+    // have us indexing before the start of the buffer below.
+    if (len < 4) {
+        if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Invalid length %hhu\n", len);
+        return MSG_BAD_LENGTH;
+    }
+
     // Peloton messages always end in F6
     if (msg[len-1] != 0xF6) {
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
-            Serial.println(F("Invalid terminator"));
-        return false;
+        if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Invalid terminator\n");
+        return MSG_BAD_TERMINATOR;
     }
 
     // First byte is always F5 / FE / F7 (head unit) or F1 (bike)
@@ -25,32 +47,77 @@ bool message_is_valid(uint8_t* msg, uint8_t len) {
     // put them first in check.
     if (! (msg[0] == 0xF5 || msg[0] == 0xF1 ||
            msg[0] == 0xF7 || msg[0] == 0xFE)) {
-        if (LOG_LEVEL >= LOG_LEVEL_DEBUG) Serial.println(F("Invalid header"));
-        return false;
+        if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Invalid header\n");
+        return MSG_BAD_HEADER;
     }
 
     // Verify length
     if (msg[0] == 0xF1) {
         if (msg[2] + 5 != len) {
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) Serial.println(F("Invalid length F1"));
-            return false;
+            if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Invalid length F1\n");
+            return MSG_BAD_LENGTH;
         }
     } else if (msg[0] == 0xF5 || msg[0] == 0xFE || msg[0] == 0xF7) {
         if (len != 4) {
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
-                Serial.print(F("Invalid length HU "));
-                Serial.println(len);
-            } 
-            return false;
+            if (log_enabled<LOG_LEVEL_DEBUG>()) LOGF("Invalid length HU %hhu\n", len);
+            return MSG_BAD_LENGTH;
         }
     }
 
     // Verify checksum
     uint8_t checksum = 0;
     for (uint8_t i = 0; i < len-2; checksum += msg[i++]);
-    if (checksum != msg[len-2]) return false;
+    if (checksum != msg[len-2]) return MSG_BAD_CHECKSUM;
 
-    return true;
+    return MSG_OK;
+}
+
+bool message_is_valid(uint8_t* msg, uint8_t len) {
+    return message_status(msg, len) == MSG_OK;
+}
+
+/* Receive framing, one byte at a time. receive_message_pair() feeds each
+ * byte from the HU or bike line in here; the buffer, its fill count and
+ * the running checksum belong to the caller. Returns FRAME_* flags.
+ */
+#define HU_MSG_BUF_LEN 4
+#define BIKE_MSG_BUF_LEN 15
+#define FRAME_STARTED  0x01    // a header byte reset the buffer
+#define FRAME_COMPLETE 0x02    // the terminator arrived
+
+uint8_t frame_byte(const uint8_t next_byte, const bool header,
+                   uint8_t* buf, const uint8_t buf_len,
+                   uint8_t& buf_bytes, uint8_t& running_checksum) {
+    uint8_t flags = 0;
+    // A header value is only a new frame if it isn't this one's checksum
+    const bool new_frame = header && next_byte != running_checksum;
+    if (buf_bytes > (buf_len - 1) || new_frame) {
+        // Reset - overflow, or starting a new message. Overflow always
+        // resets: a full buffer has no room for even a checksum byte.
+        buf_bytes = running_checksum = 0;
+        if (new_frame) flags |= FRAME_STARTED;
+    }
+    buf[buf_bytes++] = next_byte;
+    running_checksum += next_byte;
+    if (next_byte == 0xF6) {
+        // End message
+        running_checksum = 0;
+        flags |= FRAME_COMPLETE;
+    }
+    return flags;
+}
+
+uint8_t frame_hu_byte(const uint8_t next_byte, uint8_t* buf,
+                      uint8_t& buf_bytes, uint8_t& running_checksum) {
+    return frame_byte(next_byte,
+                      next_byte == 0xFE || next_byte == 0xF5 || next_byte == 0xF7,
+                      buf, HU_MSG_BUF_LEN, buf_bytes, running_checksum);
+}
+
+uint8_t frame_bike_byte(const uint8_t next_byte, uint8_t* buf,
+                        uint8_t& buf_bytes, uint8_t& running_checksum) {
+    return frame_byte(next_byte, next_byte == 0xF1,
+                      buf, BIKE_MSG_BUF_LEN, buf_bytes, running_checksum);
 }
 
 
@@ -88,11 +155,14 @@ class BikeMessage {
     Requests request;
     uint16_t value;
     bool is_valid;
+    msg_status_t status;
     // Only parse valid messages _from the bike_, not the HU
     BikeMessage(uint8_t* bike_msg, const uint8_t len) {
         request = 0;
         value = 0;
-        if (!message_is_valid(bike_msg, len) || bike_msg[0] != 0xF1) {
+        status = message_status(bike_msg, len);
+        if (status == MSG_OK && bike_msg[0] != 0xF1) status = MSG_WRONG_SOURCE;
+        if (status != MSG_OK) {
             is_valid = false;
             return;
         }
@@ -106,8 +176,15 @@ class BikeMessage {
         for (uint8_t i = 2 + payload_length; i > 2; i--) {
             // -30 = Convert from ASCII to numeric
             uint8_t next_digit = bike_msg[i] - 0x30;
+            // Bytes below '0' wrap around, so this catches both sides
+            if (next_digit > 9) {
+                status = MSG_BAD_DIGIT;
+                is_valid = false;
+                return;
+            }
             // Check for overflow
             if (value > 6553 || (value == 6553 && next_digit > 5)) {
+                status = MSG_DIGIT_OVERFLOW;
                 is_valid = false;
                 return;
             }
@@ -126,9 +203,14 @@ class HUMessage {
     HUPacketType packet_type;
     Requests request;
     bool is_valid;
+    msg_status_t status;
     HUMessage(uint8_t* hu_msg, const uint8_t len) {
-        if (!message_is_valid(hu_msg, len) ||
+        status = message_status(hu_msg, len);
+        if (status == MSG_OK &&
             !(hu_msg[0] == 0xF5 || hu_msg[0] == 0xF7 || hu_msg[0] == 0xFE)) {
+            status = MSG_WRONG_SOURCE;
+        }
+        if (status != MSG_OK) {
             is_valid = false;
             return;
         }
@@ -152,10 +234,7 @@ class SimulatedSerial {
         return;
     }
     void listen();
-    int8_t available() {
-        if (loc < len) return len - loc;
-        else return 0;
-    }
+    int8_t available();
     uint8_t read() {
         if (!available()) return 0xFF;
         else return buf[loc++];
@@ -166,6 +245,14 @@ class SimulatedSerial {
         loc = 0;
         len = nbytes;
     }
+    void push_byte(const uint8_t b) {
+        // Drop on overflow, as SoftwareSerial does
+        if (loc == len) loc = len = 0;
+        if (len < sizeof(buf)) buf[len++] = b;
+    }
+    void clear() {
+        len = loc = 0;
+    }
 };
 
 // Real-ish values. Delta encoded to save space rather than
@@ -176,20 +263,92 @@ uint8_t const RESISTANCE_LUT_DELTA_ENCODED[] PROGMEM = {
      24, 18, 16, 13, 15, 12, 10, 10,
       9,  8,  6,  8,  6,  5,  4};
 
+/* In replay mode the simulator plays back bytes recorded off the Peloton
+ * lines, sent by tools/replay.py over USB serial, instead of making up its
+ * own messages. Each byte is one record:
+ *  0  uint8   sync 0xA8
+ *  1  uint8   flags (REPLAY_FROM_BIKE, REPLAY_GAP_ONLY)
+ *  2  uint16  microseconds after the previous record, little endian
+ *  4  uint8   the byte; unused in a REPLAY_GAP_ONLY record, which only
+ *             carries a gap too long for one record
+ * Each byte arrives on its port at its recorded time, framed or not, and
+ * is lost if that port isn't listening, as on the bus. The host sends
+ * records ahead of time and USB flow control holds it back.
+ */
+#define REPLAY_SYNC 0xA8
+#define REPLAY_RECORD_LEN 5
+#define REPLAY_FROM_BIKE 0x01
+#define REPLAY_GAP_ONLY 0x02
+// One byte at 19200 baud, start bit to stop bit
+#define REPLAY_BYTE_US 521
+
 class PelotonSimulator {
     public:
     SimulatedSerial hu, bike;
     uint8_t next_message_to_send;
     uint32_t last_hu_timestamp;
+    bool replay;
+    uint8_t replay_record[REPLAY_RECORD_LEN];
+    bool replay_pending;
+    bool replay_started;
+    uint32_t replay_due;
+    uint8_t listening;
 
     PelotonSimulator(): hu(0, this), bike(1, this),
                         next_message_to_send(UNKNOWN_INIT_REQUEST),
-                        last_hu_timestamp(0) {
+                        last_hu_timestamp(0), replay(false),
+                        replay_pending(false), replay_started(false),
+                        replay_due(0), listening(0) {
     };
+    bool replay_fetch() {
+        if (replay_pending) return true;
+        while (Serial.available() > 0 && Serial.peek() != REPLAY_SYNC) Serial.read();
+        if (Serial.available() < REPLAY_RECORD_LEN) return false;
+        Serial.readBytes(replay_record, REPLAY_RECORD_LEN);
+        // Gaps count from the first record, so time spent waiting on USB
+        // delays the rest of the session instead of squeezing it
+        if (!replay_started) {
+            replay_due = micros();
+            replay_started = true;
+        }
+        replay_due += replay_record[2] | ((uint16_t) replay_record[3] << 8);
+        replay_pending = true;
+        return true;
+    }
+    void replay_poll() {
+        while (replay_fetch()) {
+            const uint8_t flags = replay_record[1];
+            const bool to_listener = !(flags & REPLAY_GAP_ONLY) &&
+                                     (flags & REPLAY_FROM_BIKE) == listening;
+            int32_t wait = (int32_t) (replay_due - micros());
+            // SoftwareSerial's receive interrupt holds the CPU from a byte's
+            // start bit to its stop bit, so a byte already on the wire for
+            // the listening port is as good as there
+            if (wait > 0 && to_listener && wait <= REPLAY_BYTE_US) {
+                delayMicroseconds(wait);
+                wait = 0;
+            }
+            if (wait > 0) return;
+            replay_pending = false;
+            if (!to_listener) continue;
+            if (listening) bike.push_byte(replay_record[4]);
+            else hu.push_byte(replay_record[4]);
+        }
+    }
     void updateState(const uint8_t bike_listening) {
         uint8_t msg[15];
         uint32_t current_time = millis();
         char logbuf[32];
+        if (replay) {
+            replay_poll();
+            if (bike_listening != listening) {
+                // Listening on another port drops what was buffered
+                hu.clear();
+                bike.clear();
+                listening = bike_listening;
+            }
+            return;
+        }
         if (!bike_listening) {
             // State machine expects messages from HU
             // If HU already has a message in buffer then don't push another.
@@ -317,6 +476,11 @@ void SimulatedSerial::listen() {
    simulator->updateState(id);
    return;
 }
+int8_t SimulatedSerial::available() {
+    if (simulator->replay) simulator->replay_poll();
+    if (loc < len) return len - loc;
+    else return 0;
+}
 class PelotonProxy {
     private:
     PelotonSimulator simulator;
@@ -330,23 +494,28 @@ class PelotonProxy {
                        hw_bike(PIN_RX_FROM_BIKE, PIN_TX_TO_BIKE,
                                INVERT_PELOTON_SERIAL)
     {}
-    void initialize(bool select_simulator) {
-        use_simulator = select_simulator;
+    void initialize(bool select_simulator, bool select_replay = false) {
+        use_simulator = select_simulator || select_replay;
+        simulator.replay = select_replay;
         hw_bike.begin(19200);
         hw_hu.begin(19200);
     }
     void hu_listen() {
-        digitalWrite(PIN_STATE_LISTEN_HU, HIGH);
-        digitalWrite(PIN_STATE_LISTEN_BIKE, LOW);
+        TRACE_PIN(PIN_STATE_LISTEN_HU, HIGH);
+        TRACE_PIN(PIN_STATE_LISTEN_BIKE, LOW);
         if (use_simulator) simulator.hu.listen();
         else hw_hu.listen();
     }
     void bike_listen() {
-        digitalWrite(PIN_STATE_LISTEN_HU, LOW);
-        digitalWrite(PIN_STATE_LISTEN_BIKE, HIGH);
+        TRACE_PIN(PIN_STATE_LISTEN_HU, LOW);
+        TRACE_PIN(PIN_STATE_LISTEN_BIKE, HIGH);
         if (use_simulator) simulator.bike.listen();
         else hw_bike.listen();
     }
+    bool replaying() const {
+        // Replay records arrive on USB serial, so it can't take commands
+        return use_simulator && simulator.replay;
+    }
     int8_t hu_available() {
         if (use_simulator) return simulator.hu.available();
         else return hw_hu.available();
@@ -0,0 +1,148 @@
+/* Protocol health counters: how well the HU/bike link is being decoded.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __PROTOCOL_HEALTH_H__
+#define __PROTOCOL_HEALTH_H__
+
+// Steady-state requests get their own success counters; boot-time
+// requests (resistance table, bike ID) share the last slot.
+#define HEALTH_REQUEST_TYPES 4
+
+/* Packed health block, as served by the optional health characteristic
+ * (little-endian, HEALTH_BLOCK_LEN bytes, defined in BLECyclingGatt.h):
+ *  0  uint8   format version (1)
+ *  1  uint16  valid pairs
+ *  3  uint16  bike timeouts
+ *  5  uint16  invalid HU messages, all reasons
+ *  7  uint16  invalid bike messages, all reasons
+ *  9  uint16  bike digit overflows (also counted in the above)
+ * 11  uint8   RPM success rate, % of requests with a valid reply
+ * 12  uint8   power success rate, %
+ * 13  uint8   resistance success rate, %
+ * 14  uint32  ms since the last valid pair (0xFFFFFFFF if none yet)
+ */
+#define HEALTH_FORMAT_VERSION 1
+
+class ProtocolHealth {
+    private:
+    // All counters saturate at 0xFFFF rather than wrapping
+    uint16_t pairs_ok;
+    uint16_t bike_timeouts;
+    uint16_t hu_invalid[MSG_STATUS_COUNT];      // by msg_status_t; [MSG_OK] unused
+    uint16_t bike_invalid[MSG_STATUS_COUNT];
+    uint16_t requests[HEALTH_REQUEST_TYPES];
+    uint16_t replies_ok[HEALTH_REQUEST_TYPES];
+    unsigned long last_valid_ms;
+
+    static void increment(uint16_t& counter) {
+        if (counter != 0xFFFF) counter++;
+    }
+    static uint8_t request_index(const uint8_t request) {
+        switch (request) {
+            case RPM: return 0;
+            case POWER: return 1;
+            case RESISTANCE: return 2;
+            default: return 3;
+        }
+    }
+    static uint16_t total(const uint16_t* counters) {
+        uint32_t sum = 0;
+        for (uint8_t i = 1; i < MSG_STATUS_COUNT; i++) sum += counters[i];
+        return sum > 0xFFFF ? 0xFFFF : sum;
+    }
+    uint8_t success_pct(const uint8_t index) const {
+        if (requests[index] == 0) return 0;
+        return ((uint32_t) replies_ok[index] * 100) / requests[index];
+    }
+
+    public:
+    ProtocolHealth(): pairs_ok(0), bike_timeouts(0), last_valid_ms(0) {
+        memset(hu_invalid, 0, sizeof(hu_invalid));
+        memset(bike_invalid, 0, sizeof(bike_invalid));
+        memset(requests, 0, sizeof(requests));
+        memset(replies_ok, 0, sizeof(replies_ok));
+    }
+    void record_pair(const HUMessage& hu, const BikeMessage& bike,
+                     const unsigned long now) {
+        if (!hu.is_valid) increment(hu_invalid[hu.status]);
+        if (!bike.is_valid) increment(bike_invalid[bike.status]);
+        // Without a valid HU message we don't know what was asked for
+        if (!hu.is_valid) return;
+        const uint8_t index = request_index(hu.request);
+        increment(requests[index]);
+        if (bike.is_valid) {
+            increment(replies_ok[index]);
+            increment(pairs_ok);
+            last_valid_ms = now;
+        }
+    }
+    void record_bike_timeout(uint8_t* hu_buf, const uint8_t hu_len) {
+        increment(bike_timeouts);
+        HUMessage hu(hu_buf, hu_len);
+        if (hu.is_valid) increment(requests[request_index(hu.request)]);
+        else increment(hu_invalid[hu.status]);
+    }
+    uint32_t millis_since_valid(const unsigned long now) const {
+        if (pairs_ok == 0) return 0xFFFFFFFF;
+        return now - last_valid_ms;
+    }
+    uint8_t pack(uint8_t* buf, const unsigned long now) const {
+        uint8_t base = 0;
+        const uint8_t version = HEALTH_FORMAT_VERSION;
+        const uint16_t hu_bad = total(hu_invalid);
+        const uint16_t bike_bad = total(bike_invalid);
+        const uint8_t rpm_pct = success_pct(0);
+        const uint8_t power_pct = success_pct(1);
+        const uint8_t resistance_pct = success_pct(2);
+        const uint32_t since_valid = millis_since_valid(now);
+        APPEND_BUFFER(buf, base, version);
+        APPEND_BUFFER(buf, base, pairs_ok);
+        APPEND_BUFFER(buf, base, bike_timeouts);
+        APPEND_BUFFER(buf, base, hu_bad);
+        APPEND_BUFFER(buf, base, bike_bad);
+        APPEND_BUFFER(buf, base, bike_invalid[MSG_DIGIT_OVERFLOW]);
+        APPEND_BUFFER(buf, base, rpm_pct);
+        APPEND_BUFFER(buf, base, power_pct);
+        APPEND_BUFFER(buf, base, resistance_pct);
+        APPEND_BUFFER(buf, base, since_valid);
+        return base;
+    }
+    void print(Logger& logger, const unsigned long now) const {
+        // Order matches msg_status_t and request_index()
+        static const char reasons[MSG_STATUS_COUNT][7] PROGMEM = {
+            "", "term", "header", "length", "csum", "source", "digits",
+            "nondig"};
+        static const char types[HEALTH_REQUEST_TYPES][6] PROGMEM = {
+            "rpm", "power", "res", "other"};
+        char buf[48];
+        snprintf_P(buf, 48, PSTR("Valid pairs %u, bike timeouts %u\n"),
+                   pairs_ok, bike_timeouts);
+        logger.print(buf);
+        if (pairs_ok == 0) {
+            logger.println(F("No valid pair yet"));
+        } else {
+            snprintf_P(buf, 48, PSTR("Last valid pair %lums ago\n"),
+                       millis_since_valid(now));
+            logger.print(buf);
+        }
+        logger.println(F("invalid\tHU\tbike"));
+        for (uint8_t i = 1; i < MSG_STATUS_COUNT; i++) {
+            snprintf_P(buf, 48, PSTR("%S\t%u\t%u\n"), reasons[i],
+                       hu_invalid[i], bike_invalid[i]);
+            logger.print(buf);
+        }
+        logger.println(F("request\tsent\tok\tok%"));
+        for (uint8_t i = 0; i < HEALTH_REQUEST_TYPES; i++) {
+            snprintf_P(buf, 48, PSTR("%S\t%u\t%u\t%hhu\n"), types[i],
+                       requests[i], replies_ok[i], success_pct(i));
+            logger.print(buf);
+        }
+    }
+};
+#endif
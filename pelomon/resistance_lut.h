@@ -73,6 +73,7 @@ class ResistanceLUT
         lut[index] = raw_value;
         synced = false;
         valid_ = valid_ && raw_value != 0xFFFF;
+        return true;
       }
       void sync_to_eeprom() {
           if (!is_valid()) return;
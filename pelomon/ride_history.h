@@ -0,0 +1,320 @@
+/* Ride history in EEPROM, and a windowed bulk download of it over the
+ * BLE UART for riders who lost their head unit connection.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef RIDE_HISTORY_H
+#define RIDE_HISTORY_H
+#include <EEPROM.h>
+
+/* SRAM is too tight for more than a few dozen samples, so the history is
+ * a ring in the otherwise unused top of the EEPROM. Only riding time is
+ * recorded (power or cadence non-zero), so a head unit left on doesn't
+ * overwrite the last ride with idle samples. Each sample covers
+ * HISTORY_SAMPLE_INTERVAL_MILLIS of riding:
+ *  uint16 mean power, W (little-endian)
+ *  uint8  mean cadence, rpm (clamped to 255)
+ *  uint8  resistance 0-100 at the end of the interval (0xFF if unknown)
+ * A stop ends the interval early, so the last sample before a pause may be
+ * shorter.
+ * The slot after the newest sample is always left blank (all 0xFF, which
+ * no real sample can be), so initialize() can find where we left off
+ * after a reboot without an index cell that would wear out. Each cell is
+ * rewritten twice per ring lap (blanked, then filled), i.e. twice per
+ * hour or so of riding, well within its endurance.
+ */
+#define HISTORY_SAMPLE_LEN 4
+#define HISTORY_SLOTS ((EEPROM_HISTORY_END_ADDRESS - \
+                        EEPROM_HISTORY_START_ADDRESS) / HISTORY_SAMPLE_LEN)
+#define HISTORY_CAPACITY (HISTORY_SLOTS - 1)
+#define HISTORY_BLANK 0xFF
+
+class RideHistory {
+    private:
+    uint16_t head;          // the blank slot; next sample goes here
+    uint16_t count_;
+    // Running totals for the interval in progress
+    unsigned long interval_start;
+    uint32_t watts_sum;
+    uint32_t cadence_sum;
+    uint16_t interval_updates;
+    uint8_t last_resistance;
+    bool paused;
+
+    static int slot_address(const uint16_t slot) {
+        return EEPROM_HISTORY_START_ADDRESS + slot * HISTORY_SAMPLE_LEN;
+    }
+    static bool slot_blank(const uint16_t slot) {
+        int address = slot_address(slot);
+        for (uint8_t i = 0; i < HISTORY_SAMPLE_LEN; i++) {
+            if (EEPROM.read(address++) != HISTORY_BLANK) return false;
+        }
+        return true;
+    }
+
+    void write_sample() {
+        // ~13ms of EEPROM writes, so only once per sample interval
+        uint16_t watts = watts_sum / interval_updates;
+        const uint16_t cadence = cadence_sum / interval_updates;
+        interval_updates = 0;
+        watts_sum = cadence_sum = 0;
+        // Keep real samples distinguishable from a blank slot
+        if (watts == 0xFFFF) watts = 0xFFFE;
+        // Blank the next slot before filling this one: losing power in
+        // between leaves two blank slots, which initialize() handles.
+        const uint16_t next = (head + 1) % HISTORY_SLOTS;
+        int address = slot_address(next);
+        for (uint8_t i = 0; i < HISTORY_SAMPLE_LEN; i++) {
+            EEPROM.update(address++, HISTORY_BLANK);
+        }
+        address = slot_address(head);
+        EEPROM.update(address++, watts & 0xFF);
+        EEPROM.update(address++, watts >> 8);
+        EEPROM.update(address++, cadence > 0xFF ? 0xFF : cadence);
+        EEPROM.update(address, last_resistance);
+        head = next;
+        if (count_ < HISTORY_CAPACITY) count_++;
+    }
+
+    public:
+    RideHistory(): head(0), count_(0), interval_start(0), watts_sum(0),
+        cadence_sum(0), interval_updates(0), last_resistance(0xFF),
+        paused(false) {};
+    void initialize() {
+        // The head is the blank slot following a sample. A fresh EEPROM is
+        // all blank, so it has none and we start at slot 0.
+        head = count_ = 0;
+        bool previous_blank = slot_blank(HISTORY_SLOTS - 1);
+        bool head_found = false;
+        for (uint16_t slot = 0; slot < HISTORY_SLOTS; slot++) {
+            const bool blank = slot_blank(slot);
+            if (!blank) count_++;
+            if (blank && !previous_blank && !head_found) {
+                head = slot;
+                head_found = true;
+            }
+            previous_blank = blank;
+        }
+        if (count_ > HISTORY_CAPACITY) count_ = HISTORY_CAPACITY;
+    }
+    void clear() {
+        // For factory reset: an all-blank ring is an empty history
+        for (int address = EEPROM_HISTORY_START_ADDRESS;
+             address < EEPROM_HISTORY_END_ADDRESS; address++) {
+            EEPROM.update(address, HISTORY_BLANK);
+        }
+        head = count_ = 0;
+        interval_updates = 0;
+        watts_sum = cadence_sum = 0;
+    }
+    void record(const unsigned long now, const uint16_t watts,
+                const uint16_t cadence, const uint8_t resistance) {
+        // Called for every message pair; averages them into samples
+        if (paused) return;
+        if (watts == 0 && cadence == 0) {
+            // Stopped: close out whatever riding we have, record nothing
+            if (interval_updates > 0) write_sample();
+            return;
+        }
+        if (interval_updates == 0) interval_start = now;
+        watts_sum += watts;
+        cadence_sum += cadence;
+        interval_updates++;
+        last_resistance = resistance;
+        if (now - interval_start >= HISTORY_SAMPLE_INTERVAL_MILLIS) write_sample();
+    }
+    uint16_t count() const {
+        return count_;
+    }
+    void read(const uint16_t index, uint8_t* sample) const {
+        // index 0 is the oldest sample still in the ring
+        const uint16_t slot = (head + HISTORY_SLOTS - count_ + index) % HISTORY_SLOTS;
+        int address = slot_address(slot);
+        for (uint8_t i = 0; i < HISTORY_SAMPLE_LEN; i++) {
+            sample[i] = EEPROM.read(address++);
+        }
+    }
+    void set_paused(const bool pause) {
+        // Freeze the ring while a download is reading it
+        paused = pause;
+    }
+};
+
+/* Download protocol, decoded by tools/fetch_history.py.
+ *
+ * Every frame is exactly one SDEP packet (16 bytes), little-endian:
+ *  0  uint8   sync 0xA6
+ *  1  uint8   frame sequence number (mod 256)
+ *  2  12 bytes payload
+ * 14  uint16  CRC-16/XMODEM over bytes 0-13
+ * Frame 0 payload: uint16 sample count, uint16 sample period (ms),
+ * uint8 sample length, uint8 format version, zero padding.
+ * Frames 1.. carry three samples each, oldest first; the last is padded
+ * with 0xFF.
+ *
+ * The host answers with two-byte messages on the UART:
+ *  0x06 seq  ACK: every frame up to and including seq arrived
+ *  0x15 seq  NAK: resend starting from seq
+ *  0x18 any  cancel the transfer
+ * Up to HISTORY_WINDOW_FRAMES unacknowledged frames are in flight; if no
+ * ACK arrives within HISTORY_ACK_TIMEOUT_MILLIS we go back to the oldest
+ * unacknowledged frame. Text log output may still be interleaved with
+ * frames, so the host resyncs on the sync byte and CRC.
+ */
+#define HISTORY_FRAME_LEN SDEP_MAX_PACKETSIZE
+#define HISTORY_FRAME_PAYLOAD_LEN (HISTORY_FRAME_LEN - 4)
+#define HISTORY_SAMPLES_PER_FRAME (HISTORY_FRAME_PAYLOAD_LEN / HISTORY_SAMPLE_LEN)
+#define HISTORY_FORMAT_VERSION 1
+#define HISTORY_SYNC   0xA6
+#define HISTORY_ACK    0x06
+#define HISTORY_NAK    0x15
+#define HISTORY_CANCEL 0x18
+#define HISTORY_WINDOW_FRAMES 8
+// Frames per writeBLEUart, i.e. per SDEP response we wait on
+#define HISTORY_BATCH_FRAMES 4
+#define HISTORY_ACK_TIMEOUT_MILLIS 1000
+#define HISTORY_MAX_RETRIES 5
+
+class HistoryTransfer {
+    private:
+    Adafruit_BLE& ble_;
+    Logger& logger;
+    RideHistory& history;
+    bool active_;
+    uint16_t sample_count;
+    uint16_t num_frames;
+    uint16_t base_frame;    // oldest unacknowledged
+    uint16_t next_frame;    // next to send
+    unsigned long last_progress_ts;
+    uint8_t retries;
+    uint8_t pending_op;     // first byte of a host message awaiting its second
+
+    void finish() {
+        active_ = false;
+        history.set_paused(false);
+    }
+
+    bool frame_index(const uint8_t seq, uint16_t& index) const {
+        // Map a sequence number back onto the frames in flight
+        const uint8_t delta = seq - (uint8_t) base_frame;
+        if (delta >= next_frame - base_frame) return false;
+        index = base_frame + delta;
+        return true;
+    }
+
+    void build_frame(const uint16_t frame, uint8_t* buf) const {
+        uint8_t base = 0;
+        const uint8_t sync = HISTORY_SYNC;
+        const uint8_t seq = frame & 0xFF;
+        APPEND_BUFFER(buf, base, sync);
+        APPEND_BUFFER(buf, base, seq);
+        memset(buf + base, frame == 0 ? 0 : 0xFF, HISTORY_FRAME_PAYLOAD_LEN);
+        if (frame == 0) {
+            const uint16_t interval = HISTORY_SAMPLE_INTERVAL_MILLIS;
+            const uint8_t sample_len = HISTORY_SAMPLE_LEN;
+            const uint8_t version = HISTORY_FORMAT_VERSION;
+            APPEND_BUFFER(buf, base, sample_count);
+            APPEND_BUFFER(buf, base, interval);
+            APPEND_BUFFER(buf, base, sample_len);
+            APPEND_BUFFER(buf, base, version);
+        } else {
+            uint16_t sample = (frame - 1) * HISTORY_SAMPLES_PER_FRAME;
+            for (uint8_t i = 0; i < HISTORY_SAMPLES_PER_FRAME &&
+                                sample < sample_count; i++, sample++) {
+                history.read(sample, buf + base);
+                base += HISTORY_SAMPLE_LEN;
+            }
+        }
+        base = HISTORY_FRAME_LEN - 2;
+        const uint16_t crc = crc16_xmodem(buf, base);
+        APPEND_BUFFER(buf, base, crc);
+    }
+
+    public:
+    HistoryTransfer(Adafruit_BLE& ble, Logger& logger_, RideHistory& history_):
+        ble_(ble), logger(logger_), history(history_), active_(false),
+        sample_count(0), num_frames(0), base_frame(0), next_frame(0),
+        last_progress_ts(0), retries(0), pending_op(0) {};
+
+    bool active() const {
+        return active_;
+    }
+
+    void start() {
+        if (active_) return;
+        history.set_paused(true);
+        sample_count = history.count();
+        num_frames = 1 + ((sample_count + HISTORY_SAMPLES_PER_FRAME - 1) /
+                          HISTORY_SAMPLES_PER_FRAME);
+        base_frame = next_frame = 0;
+        retries = 0;
+        pending_op = 0;
+        last_progress_ts = millis();
+        // Get any pending text out ahead of the first frame
+        logger.flush();
+        active_ = true;
+    }
+
+    void handle_rx(const char data[], const uint16_t len) {
+        for (uint16_t i = 0; i < len && active_; i++) {
+            const uint8_t byte = data[i];
+            if (pending_op == 0) {
+                if (byte == HISTORY_ACK || byte == HISTORY_NAK ||
+                    byte == HISTORY_CANCEL) {
+                    pending_op = byte;
+                }
+                continue;
+            }
+            const uint8_t op = pending_op;
+            pending_op = 0;
+            uint16_t index;
+            if (op == HISTORY_CANCEL) {
+                finish();
+            } else if (!frame_index(byte, index)) {
+                // Stale or bogus; a timeout recovers if it mattered
+                continue;
+            } else if (op == HISTORY_ACK) {
+                base_frame = index + 1;
+                retries = 0;
+                last_progress_ts = millis();
+                if (base_frame == num_frames) finish();
+            } else {
+                base_frame = next_frame = index;
+                last_progress_ts = millis();
+            }
+        }
+    }
+
+    void service() {
+        if (!active_) return;
+        const unsigned long now = millis();
+        if (next_frame > base_frame &&
+            now - last_progress_ts >= HISTORY_ACK_TIMEOUT_MILLIS) {
+            if (++retries > HISTORY_MAX_RETRIES) {
+                finish();
+                logger.println(F("History transfer timed out"));
+                return;
+            }
+            // Go back N
+            next_frame = base_frame;
+            last_progress_ts = now;
+        }
+        uint16_t window_end = base_frame + HISTORY_WINDOW_FRAMES;
+        if (window_end > num_frames) window_end = num_frames;
+        while (next_frame < window_end) {
+            uint8_t buf[HISTORY_BATCH_FRAMES * HISTORY_FRAME_LEN];
+            uint8_t frames = 0;
+            while (frames < HISTORY_BATCH_FRAMES && next_frame < window_end) {
+                build_frame(next_frame++, buf + frames * HISTORY_FRAME_LEN);
+                frames++;
+            }
+            ble_.writeBLEUart(buf, frames * HISTORY_FRAME_LEN);
+        }
+    }
+};
+#endif
@@ -9,13 +9,44 @@
  */
 #define SIMULATOR_MESSAGE_INTERVAL_MILLIS 100
 
-#define BT_UPDATE_INTERVAL_MILLIS 500
+// BLE updates are sent once a fresh RPM+power pair has arrived from the
+// bike, but never more often than MIN or less often than MAX.
+#define BT_UPDATE_MIN_INTERVAL_MILLIS 250
+#define BT_UPDATE_MAX_INTERVAL_MILLIS 1000
+
+// Poll the BLE module for events (SC Control Point writes, BLE UART RX)
+// at most every INTERVAL, and only within WINDOW of a completed HU/bike
+// message pair so the poll can't overlap the next Peloton frame...
+#define BLE_EVENT_POLL_INTERVAL_MILLIS 200
+#define BLE_EVENT_POLL_WINDOW_MILLIS   50
+// ...or at any time once the bike has gone quiet for this long
+#define BLE_EVENT_POLL_IDLE_MILLIS   1000
+
+// With ENABLE_HEALTH_GATT, refresh the protocol health characteristic
+// this often
+#define HEALTH_GATT_UPDATE_INTERVAL_MILLIS 5000
+
+// Riding time averaged into each ride history sample; the EEPROM ring
+// holds 223 samples, just under an hour of riding
+#define HISTORY_SAMPLE_INTERVAL_MILLIS 15000
+
+// Scan the painted stack for its high-water mark this often, and warn once
+// if it has come within LOW_WATER bytes of the heap
+#define STACK_CHECK_INTERVAL_MILLIS 1000
+#define STACK_LOW_WATER_BYTES 64
 
 #define LOG_LEVEL_NONE  0
 #define LOG_LEVEL_INFO  1
 #define LOG_LEVEL_DEBUG 2
 #define LOG_LEVEL_MAX   255
 
+// Most verbose level compiled in. Log statements above it are stripped,
+// strings and all; the runtime LOG_LEVEL can only narrow below it. Set to
+// LOG_LEVEL_INFO for a leaner production build.
+#ifndef LOG_LEVEL_COMPILED
+#define LOG_LEVEL_COMPILED LOG_LEVEL_DEBUG
+#endif
+
 /*
  *  Pin usage and available pins
  *  https://learn.adafruit.com/adafruit-feather-32u4-bluefruit-le/pinouts
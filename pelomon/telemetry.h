@@ -0,0 +1,129 @@
+/* Compact binary ride telemetry, an alternative to the text status lines.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/* Frame layout (little-endian), decoded by tools/decode_telemetry.py:
+ *  0  uint8   sync 0xA5
+ *  1  uint8   sync 0x5A
+ *  2  uint8   version (TELEMETRY_VERSION)
+ *  3  uint8   payload length
+ *  4  uint8   sequence number
+ *  5  uint32  timestamp, ms since boot
+ *  9  uint16  cadence, rpm
+ * 11  uint16  power, deciwatts
+ * 13  uint16  raw resistance
+ * 15  uint8   resistance 0-100 (0xFF if LUT invalid)
+ * 16  uint16  cumulative crank revolutions
+ * 18  uint32  cumulative wheel revolutions
+ * 22  uint32  accumulated energy, joules
+ * 26  uint16  CRC-16/XMODEM over bytes 0-25 (crc16_xmodem in binlog.h)
+ */
+#define TELEMETRY_SYNC_0 0xA5
+#define TELEMETRY_SYNC_1 0x5A
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_LEN 4
+#define TELEMETRY_PAYLOAD_LEN 22
+#define TELEMETRY_FRAME_LEN (TELEMETRY_HEADER_LEN + TELEMETRY_PAYLOAD_LEN + 2)
+
+/* In replay mode every BLE update is also echoed as a GATT trace frame,
+ * holding the exact CP and CSC measurement bytes sent to the head unit.
+ * tools/golden_trace.py checks these against a recorded golden run.
+ *  0  uint8   sync 0xA5
+ *  1  uint8   sync 0x5E
+ *  2  uint8   version (GATT_TRACE_VERSION)
+ *  3  uint8   payload length
+ *  4  uint32  timestamp, ms since boot
+ *  8  uint8   CP measurement length C
+ *  9  C bytes CP measurement
+ *     uint8   CSC measurement length S
+ *     S bytes CSC measurement
+ *     uint16  CRC-16/XMODEM over everything before it
+ */
+#define GATT_TRACE_SYNC_1 0x5E
+#define GATT_TRACE_VERSION 1
+#define GATT_TRACE_MAX_FRAME_LEN (TELEMETRY_HEADER_LEN + 4 + 1 + 11 + 1 + 11 + 2)
+
+class Telemetry {
+    private:
+    Logger& logger;
+    uint8_t sequence;
+    bool enabled_;
+
+    public:
+    Telemetry(Logger& logger_): logger(logger_), sequence(0), enabled_(false) {};
+    bool enabled() const {
+        return enabled_;
+    }
+    void set_enabled(const bool enable) {
+        enabled_ = enable;
+    }
+    void send(const RideStatus& ride) {
+        // Costs a few dozen us to pack vs ~11ms for the text status line
+        uint8_t frame[TELEMETRY_FRAME_LEN];
+        uint8_t base = 0;
+        const uint8_t sync_0 = TELEMETRY_SYNC_0, sync_1 = TELEMETRY_SYNC_1;
+        const uint8_t version = TELEMETRY_VERSION;
+        const uint8_t payload_len = TELEMETRY_PAYLOAD_LEN;
+        APPEND_BUFFER(frame, base, sync_0);
+        APPEND_BUFFER(frame, base, sync_1);
+        APPEND_BUFFER(frame, base, version);
+        APPEND_BUFFER(frame, base, payload_len);
+
+        const uint32_t timestamp = millis();
+        const uint16_t cadence = ride.current_cadence();
+        const uint16_t deciwatts = ride.current_deciwatts();
+        const uint16_t raw_resistance = ride.raw_resistance();
+        const uint8_t resistance = ride.resistance();
+        const uint16_t crank_revs = ride.integral_crank_revolutions();
+        const uint32_t wheel_revs = ride.integral_wheel_revolutions();
+        const uint32_t joules = ride.total_joules();
+        APPEND_BUFFER(frame, base, sequence);
+        APPEND_BUFFER(frame, base, timestamp);
+        APPEND_BUFFER(frame, base, cadence);
+        APPEND_BUFFER(frame, base, deciwatts);
+        APPEND_BUFFER(frame, base, raw_resistance);
+        APPEND_BUFFER(frame, base, resistance);
+        APPEND_BUFFER(frame, base, crank_revs);
+        APPEND_BUFFER(frame, base, wheel_revs);
+        APPEND_BUFFER(frame, base, joules);
+
+        const uint16_t crc = crc16_xmodem(frame, base);
+        APPEND_BUFFER(frame, base, crc);
+        sequence++;
+        logger.write(frame, base);
+    }
+    void send_gatt_trace(const RideStatus& ride, const unsigned long now) {
+        // Packed the same way BLECyclingPower::update() packs them
+        uint8_t frame[GATT_TRACE_MAX_FRAME_LEN];
+        uint8_t base = TELEMETRY_HEADER_LEN;
+        const uint32_t timestamp = now;
+        APPEND_BUFFER(frame, base, timestamp);
+        const uint8_t cp_len = BLECyclingPower::pack_cp_measurement(
+            frame + base + 1, ride.current_watts(), ride.total_kj());
+        frame[base] = cp_len;
+        base += 1 + cp_len;
+        const uint8_t csc_len = BLECyclingPower::pack_csc_measurement(
+            frame + base + 1, ride.integral_crank_revolutions(),
+            ride.last_crank_rev_ts_millis(), ride.integral_wheel_revolutions(),
+            ride.last_wheel_rev_ts_millis());
+        frame[base] = csc_len;
+        base += 1 + csc_len;
+
+        frame[0] = TELEMETRY_SYNC_0;
+        frame[1] = GATT_TRACE_SYNC_1;
+        frame[2] = GATT_TRACE_VERSION;
+        frame[3] = base - TELEMETRY_HEADER_LEN;
+        const uint16_t crc = crc16_xmodem(frame, base);
+        APPEND_BUFFER(frame, base, crc);
+        logger.write(frame, base);
+    }
+};
+#endif
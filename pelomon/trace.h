@@ -0,0 +1,121 @@
+/* Loop timeline trace: records each PIN_STATE_* transition with a micros()
+ * timestamp, so the timeline the state pins show on a logic analyzer can
+ * be read back with the trace command instead.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#ifdef ENABLE_TRACE
+// 3 bytes per event; a message pair is about ten events
+const uint8_t TRACE_RING_LEN = 32;
+// Spans shorter than this (e.g. READ_HU in a loop() with nothing to read)
+// are dropped so idle polling doesn't flush the ring
+#define TRACE_MIN_SPAN_US 50
+// Events store the time since the previous one in units of micros()'s
+// 4us resolution, so a 16-bit delta covers 262ms, more than a Peloton
+// cycle. Longer gaps saturate.
+#define TRACE_TICK_US 4
+uint16_t trace_deltas[TRACE_RING_LEN];
+uint8_t trace_events[TRACE_RING_LEN];   // pin, high bit set on begin
+unsigned long trace_last;   // time of the newest event
+uint8_t trace_index;
+uint8_t trace_count;
+uint8_t trace_levels;   // last level per state pin, to skip repeats
+
+uint8_t trace_pin_bit(const uint8_t pin) {
+    switch (pin) {
+        case PIN_STATE_READ_HU: return 1 << 0;
+        case PIN_STATE_READ_BIKE: return 1 << 1;
+        case PIN_STATE_PROC_MSG: return 1 << 2;
+        case PIN_STATE_LISTEN_HU: return 1 << 3;
+        case PIN_STATE_LISTEN_BIKE: return 1 << 4;
+        case PIN_STATE_HANDLE_CMD: return 1 << 5;
+        default: return 0;
+    }
+}
+
+const __FlashStringHelper* trace_pin_name(const uint8_t pin) {
+    switch (pin) {
+        case PIN_STATE_READ_HU: return F("READ_HU");
+        case PIN_STATE_READ_BIKE: return F("READ_BIKE");
+        case PIN_STATE_PROC_MSG: return F("PROC_MSG");
+        case PIN_STATE_LISTEN_HU: return F("LISTEN_HU");
+        case PIN_STATE_LISTEN_BIKE: return F("LISTEN_BIKE");
+        case PIN_STATE_HANDLE_CMD: return F("HANDLE_CMD");
+        default: return F("?");
+    }
+}
+
+void trace_pin(const uint8_t pin, const uint8_t level) {
+    digitalWrite(pin, level);
+    // hu_listen() etc. rewrite pins every loop; only record changes
+    const uint8_t bit = trace_pin_bit(pin);
+    if (((trace_levels & bit) != 0) == (level == HIGH)) return;
+    trace_levels ^= bit;
+    const unsigned long now = micros();
+    const uint8_t last = (trace_index + TRACE_RING_LEN - 1) % TRACE_RING_LEN;
+    if (level == LOW && trace_count > 0 && trace_events[last] == (pin | 0x80) &&
+        now - trace_last < TRACE_MIN_SPAN_US) {
+        trace_index = last;
+        trace_count--;
+        trace_last -= (unsigned long) trace_deltas[last] * TRACE_TICK_US;
+        return;
+    }
+    const unsigned long ticks = (now - trace_last) / TRACE_TICK_US;
+    if (ticks > 0xFFFF) {
+        trace_deltas[trace_index] = 0xFFFF;
+        trace_last = now;
+    } else {
+        // Advance by whole ticks so rounding doesn't accumulate
+        trace_deltas[trace_index] = ticks;
+        trace_last += ticks * TRACE_TICK_US;
+    }
+    trace_events[trace_index] = pin | (level == HIGH ? 0x80 : 0);
+    trace_index = (trace_index + 1) % TRACE_RING_LEN;
+    if (trace_count < TRACE_RING_LEN) trace_count++;
+}
+
+void dump_trace(Logger& logger) {
+    // Oldest first; tools/trace_to_chrome.py turns this into trace JSON
+    char logbuf[24];
+    const uint8_t count = trace_count;
+    const uint8_t oldest = (trace_index + TRACE_RING_LEN - count) % TRACE_RING_LEN;
+    // Walk the deltas back from the newest event to time the oldest
+    unsigned long t = trace_last;
+    uint8_t i = oldest;
+    for (uint8_t j = 1; j < count; j++) {
+        i = (i + 1) % TRACE_RING_LEN;
+        t -= (unsigned long) trace_deltas[i] * TRACE_TICK_US;
+    }
+    logger.println(F("TRACE"));
+    i = oldest;
+    for (uint8_t j = 0; j < count; j++, i = (i + 1) % TRACE_RING_LEN) {
+        if (j > 0) t += (unsigned long) trace_deltas[i] * TRACE_TICK_US;
+        snprintf_P(logbuf, 24, PSTR("T %lu "), t);
+        logger.print(logbuf);
+        logger.print(trace_pin_name(trace_events[i] & 0x7F));
+        logger.println((trace_events[i] & 0x80) ? F(" B") : F(" E"));
+    }
+    trace_count = 0;
+}
+
+void init_trace(void) {
+    trace_index = trace_count = trace_levels = 0;
+    trace_last = 0;
+}
+#define TRACE_PIN(pin, level) trace_pin(pin, level)
+
+#else
+#define TRACE_PIN(pin, level) digitalWrite(pin, level)
+#define init_trace()
+#define dump_trace(logger)
+#endif
+
+#endif
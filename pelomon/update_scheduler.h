@@ -0,0 +1,55 @@
+/* Scheduler deciding when to push ride state out over BLE, driven by
+ * the arrival of fresh bike data rather than a fixed timer.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef UPDATE_SCHEDULER_H
+#define UPDATE_SCHEDULER_H
+
+/* The HU polls the bike in a fixed rotation (RPM, power, resistance),
+ * one request every 100ms, so a full RPM+power sample refreshes every
+ * 300ms. A fixed 500ms timer beats against that cycle and often sends
+ * power from a previous rotation. Instead, fire as soon as both RPM and
+ * power have been refreshed since the last update, bounded below so we
+ * never flood the radio and above so the head unit still hears from us
+ * if the bike goes quiet.
+ */
+class UpdateScheduler {
+    private:
+    unsigned long last_update_ts;
+    uint8_t fresh_fields;
+
+    static const uint8_t FRESH_RPM = 1 << 0;
+    static const uint8_t FRESH_POWER = 1 << 1;
+    static const uint8_t FRESH_CYCLE = FRESH_RPM | FRESH_POWER;
+
+    public:
+    UpdateScheduler(): last_update_ts(0), fresh_fields(0) {};
+    void initialize() {
+        fresh_fields = 0;
+        // Make the first update due immediately
+        last_update_ts = millis() - BT_UPDATE_MAX_INTERVAL_MILLIS;
+    }
+    void note_bike_message(const uint8_t request) {
+        if (request == RPM) fresh_fields |= FRESH_RPM;
+        else if (request == POWER) fresh_fields |= FRESH_POWER;
+    }
+    bool cycle_complete() const {
+        return (fresh_fields & FRESH_CYCLE) == FRESH_CYCLE;
+    }
+    bool update_due(const unsigned long now) const {
+        const unsigned long elapsed = now - last_update_ts;
+        if (elapsed >= BT_UPDATE_MAX_INTERVAL_MILLIS) return true;
+        return cycle_complete() && elapsed >= BT_UPDATE_MIN_INTERVAL_MILLIS;
+    }
+    void mark_updated(const unsigned long now) {
+        last_update_ts = now;
+        fresh_fields = 0;
+    }
+};
+#endif
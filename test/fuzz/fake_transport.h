@@ -0,0 +1,38 @@
+/* Stand-in for the Bluefruit module: an Adafruit_ATParser whose replies
+ * come from a fuzz input. Commands written to it are dropped. While no
+ * data is left, each wait for data costs 1ms of the virtual clock, so
+ * the parser's timeouts run out just as they would on the board.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef FAKE_TRANSPORT_H
+#define FAKE_TRANSPORT_H
+#include "Adafruit_ATParser.h"
+
+class FakeTransport : public Adafruit_ATParser {
+    private:
+    const uint8_t* data;
+    size_t len, pos;
+
+    protected:
+    void waitForData(void) { host_advance_us(1000); }
+
+    public:
+    FakeTransport(const uint8_t* data_, const size_t len_):
+        data(data_), len(len_), pos(0) {}
+    bool setMode(uint8_t mode) {
+        _mode = mode;
+        return true;
+    }
+    size_t write(uint8_t c) { return 1; }
+    using Print::write;
+    int available(void) { return len - pos; }
+    int read(void) { return pos < len ? data[pos++] : -1; }
+    int peek(void) { return pos < len ? data[pos] : -1; }
+};
+#endif
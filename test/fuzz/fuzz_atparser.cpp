@@ -0,0 +1,44 @@
+/* Fuzz target: Adafruit_ATParser::readline() and readraw() on arbitrary
+ * module replies. The first input byte picks the call and its options,
+ * the second the line buffer size; the rest is the reply.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include "fake_transport.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 2) return 0;
+    const uint8_t op = data[0];
+    const uint16_t bufsize = data[1] + 1;
+    FakeTransport module(data + 2, size - 2);
+
+    switch (op & 0x03) {
+    case 0: {
+        // Callers must pass bufsize + 1 bytes; allocate exactly that so
+        // ASan catches a terminator or character written past it
+        char* buf = (char*) malloc(bufsize + 1);
+        const uint16_t len = module.readline(buf, bufsize, 100, op & 0x80);
+        if (len > bufsize || strlen(buf) > len) abort();
+        free(buf);
+        break;
+    }
+    case 1: {
+        const uint16_t len = module.readline(100, op & 0x80);
+        if (len > BLE_BUFSIZE) abort();
+        break;
+    }
+    case 2:
+        if (module.readraw(100) > BLE_BUFSIZE) abort();
+        break;
+    default:
+        module.readline_parseInt();
+        break;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* Fuzz target: the receive framing, fed a byte stream the way
+ * receive_message_pair() feeds it: HU bytes until a HU frame completes,
+ * then bike bytes until a bike frame completes, then parse both and
+ * start over, as process_message_pair() does.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include "settings.h"
+#include "Adafruit_BLE.h"
+
+uint8_t LOG_LEVEL = LOG_LEVEL_DEBUG;
+
+#include "logger.h"
+#include "binlog.h"
+#include "trace.h"
+#include "peloton.h"
+
+Logger logger;
+
+void check_frame(const uint8_t flags, const uint8_t* buf, const uint8_t buf_bytes,
+                 const uint8_t buf_len, const uint8_t running_checksum) {
+    if (buf_bytes == 0 || buf_bytes > buf_len) abort();
+    if ((flags & FRAME_COMPLETE) &&
+        (buf[buf_bytes - 1] != 0xF6 || running_checksum != 0)) abort();
+    if ((flags & FRAME_STARTED) && buf_bytes != 1) abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    uint8_t hu_buf[HU_MSG_BUF_LEN];
+    uint8_t bike_buf[BIKE_MSG_BUF_LEN];
+    uint8_t hu_buf_bytes = 0, bike_buf_bytes = 0, running_checksum = 0;
+    bool bike_side = false;
+
+    for (size_t i = 0; i < size; i++) {
+        if (!bike_side) {
+            const uint8_t flags = frame_hu_byte(data[i], hu_buf, hu_buf_bytes,
+                                                running_checksum);
+            check_frame(flags, hu_buf, hu_buf_bytes, HU_MSG_BUF_LEN,
+                        running_checksum);
+            bike_side = flags & FRAME_COMPLETE;
+            continue;
+        }
+        const uint8_t flags = frame_bike_byte(data[i], bike_buf, bike_buf_bytes,
+                                              running_checksum);
+        check_frame(flags, bike_buf, bike_buf_bytes, BIKE_MSG_BUF_LEN,
+                    running_checksum);
+        if (flags & FRAME_COMPLETE) {
+            HUMessage hu_msg(hu_buf, hu_buf_bytes);
+            BikeMessage bike_msg(bike_buf, bike_buf_bytes);
+            if (hu_msg.is_valid && hu_buf[0] == 0xF1) abort();
+            if (bike_msg.is_valid && bike_buf[0] != 0xF1) abort();
+            hu_buf_bytes = bike_buf_bytes = running_checksum = 0;
+            bike_side = false;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+/* Fuzz target: the GATT table check and the ATI part of the BLE config
+ * fingerprint, run against arbitrary module replies exactly as
+ * BLECyclingPower::gatts_as_expected() and config_fingerprint() run them.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include "settings.h"
+#include "Adafruit_BLE.h"
+
+uint8_t LOG_LEVEL = LOG_LEVEL_DEBUG;
+
+#include "logger.h"
+#include "binlog.h"
+#include "BLECyclingGatt.h"
+#include "fake_transport.h"
+
+Logger logger;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // Heap buffers of the sketch's sizes so ASan sees any overrun
+    FakeTransport module(data, size);
+    char* linebuf = (char*) malloc(GATTLIST_LINE_BUF_LEN);
+    ProgmemComparatorState comparator;
+    comparator.is_equal = true;
+    comparator.line_number = 0;
+    comparator.total_lines = EXPECTED_GATT_DEFNS_LINE_COUNT;
+    comparator.pgm_entry_table = (void*) EXPECTED_GATT_DEFNS_FLETCHER16;
+    module.atcommandStrReplyPerLine(F("AT+GATTLIST"), linebuf,
+                                    GATTLIST_LINE_BUF_LEN - 1, 100,
+                                    fletcher16_comparator_callback, &comparator);
+    if (comparator.line_number > comparator.total_lines) abort();
+    free(linebuf);
+
+    // Whatever the GATT list left unread is the reply to ATI
+    linebuf = (char*) malloc(32);
+    uint16_t fingerprint = 0;
+    module.atcommandStrReplyPerLine(F("ATI"), linebuf, 31, 100,
+                                    fletcher16_chain_callback, &fingerprint);
+    free(linebuf);
+    return 0;
+}
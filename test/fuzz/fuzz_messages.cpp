@@ -0,0 +1,44 @@
+/* Fuzz target: message_status(), BikeMessage and HUMessage on one frame.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include "settings.h"
+#include "Adafruit_BLE.h"
+
+uint8_t LOG_LEVEL = LOG_LEVEL_DEBUG;
+
+#include "logger.h"
+#include "binlog.h"
+#include "trace.h"
+#include "peloton.h"
+
+Logger logger;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    // The sketch's buffers hold 15 bytes, but the parsers take any uint8_t
+    // length. Copy to a buffer of exactly that size so ASan sees overreads.
+    if (size > 255) return 0;
+    uint8_t* msg = (uint8_t*) malloc(size ? size : 1);
+    memcpy(msg, data, size);
+    const uint8_t len = size;
+
+    const msg_status_t status = message_status(msg, len);
+    if (status >= MSG_STATUS_COUNT) abort();
+    BikeMessage bike_msg(msg, len);
+    HUMessage hu_msg(msg, len);
+    if (bike_msg.is_valid != (bike_msg.status == MSG_OK)) abort();
+    if (hu_msg.is_valid != (hu_msg.status == MSG_OK)) abort();
+    if (bike_msg.is_valid && (msg[0] != 0xF1 || msg[2] + 5 != len)) abort();
+    if (hu_msg.is_valid && len != 4) abort();
+    // A frame comes from one end of the link or the other
+    if (bike_msg.is_valid && hu_msg.is_valid) abort();
+
+    free(msg);
+    return 0;
+}
@@ -0,0 +1,172 @@
+/* Driver for the fuzz targets when libFuzzer isn't available (g++ builds).
+ *
+ *   fuzz_x [--passes N] [--mutate N] [--seed S] corpus_dir_or_file...
+ *
+ * Every corpus input is run once, so a crash found by libFuzzer stays
+ * fixed once its input is added to the corpus. --passes replays the
+ * corpus N times and reports executions and megabytes per second, to
+ * compare parser changes. --mutate runs N extra inputs made by flipping,
+ * inserting and deleting bytes of corpus inputs, from a fixed seed so a
+ * failure reproduces; the failing input is written to crash-input.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <dirent.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+// Only there when built with a sanitizer
+extern "C" void __sanitizer_set_death_callback(void (*callback)(void))
+    __attribute__((weak));
+
+#define MAX_INPUT_LEN 4096
+
+typedef std::vector<uint8_t> Input;
+
+static void load(const std::string& path, std::vector<Input>& corpus) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        perror(path.c_str());
+        exit(2);
+    }
+    if (S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(path.c_str());
+        std::vector<std::string> names;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+        }
+        closedir(dir);
+        // Sorted so runs are repeatable whatever order readdir gives
+        std::sort(names.begin(), names.end());
+        for (size_t i = 0; i < names.size(); i++) load(path + "/" + names[i], corpus);
+        return;
+    }
+    FILE* f = fopen(path.c_str(), "rb");
+    Input input(MAX_INPUT_LEN);
+    input.resize(fread(&input[0], 1, MAX_INPUT_LEN, f));
+    fclose(f);
+    corpus.push_back(input);
+}
+
+static const Input* current;
+
+static void save_current(void) {
+    if (current == NULL) return;
+    FILE* f = fopen("crash-input", "wb");
+    if (f == NULL) return;
+    fwrite(current->data(), 1, current->size(), f);
+    fclose(f);
+    fprintf(stderr, "input written to crash-input\n");
+}
+
+static void on_signal(int sig) {
+    save_current();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void run(const Input& input) {
+    // Copy so the target gets a buffer of exactly the input's size
+    uint8_t* data = (uint8_t*) malloc(input.size() ? input.size() : 1);
+    if (!input.empty()) memcpy(data, input.data(), input.size());
+    LLVMFuzzerTestOneInput(data, input.size());
+    free(data);
+}
+
+static uint32_t rng_state;
+static uint32_t next_random(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static Input mutate(Input input) {
+    const uint32_t edits = 1 + next_random() % 4;
+    for (uint32_t i = 0; i < edits; i++) {
+        const uint32_t r = next_random();
+        const size_t at = input.empty() ? 0 : r % input.size();
+        switch ((r >> 24) % 4) {
+        case 0:
+            if (!input.empty()) input[at] ^= 1 << (next_random() % 8);
+            break;
+        case 1:
+            if (!input.empty()) input[at] = next_random();
+            break;
+        case 2:
+            if (input.size() < MAX_INPUT_LEN) input.insert(input.begin() + at, next_random());
+            break;
+        default:
+            if (!input.empty()) input.erase(input.begin() + at);
+            break;
+        }
+    }
+    return input;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv) {
+    unsigned long passes = 1, mutations = 0;
+    rng_state = 0x5EED;
+    std::vector<Input> corpus;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--passes") && i + 1 < argc) {
+            passes = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--mutate") && i + 1 < argc) {
+            mutations = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            rng_state = strtoul(argv[++i], NULL, 0) | 1;
+        } else {
+            load(argv[i], corpus);
+        }
+    }
+    if (corpus.empty()) {
+        fprintf(stderr, "usage: %s [--passes N] [--mutate N] [--seed S] corpus...\n",
+                argv[0]);
+        return 2;
+    }
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < corpus.size(); i++) bytes += corpus[i].size();
+    const double start = now_seconds();
+    for (unsigned long pass = 0; pass < passes; pass++) {
+        for (size_t i = 0; i < corpus.size(); i++) run(corpus[i]);
+    }
+    const double elapsed = now_seconds() - start;
+    const double execs = (double) passes * corpus.size();
+    fprintf(stderr, "%s: %lu passes over %zu inputs (%zu bytes) in %.3fs: "
+            "%.0f execs/s, %.2f MB/s\n", argv[0], passes, corpus.size(), bytes,
+            elapsed, execs / elapsed, passes * bytes / elapsed / 1e6);
+
+    if (__sanitizer_set_death_callback) __sanitizer_set_death_callback(save_current);
+    signal(SIGABRT, on_signal);
+    signal(SIGSEGV, on_signal);
+    for (unsigned long n = 0; n < mutations; n++) {
+        const Input input = mutate(corpus[next_random() % corpus.size()]);
+        current = &input;
+        run(input);
+        current = NULL;
+    }
+    if (mutations) fprintf(stderr, "%s: %lu mutated inputs\n", argv[0], mutations);
+    return 0;
+}
@@ -0,0 +1,20 @@
+# Run one session through replay_pipeline and compare with its golden file.
+# Called by the golden_* tests in CMakeLists.txt.
+execute_process(COMMAND ${PROGRAM} ${INPUT}
+                OUTPUT_FILE ${OUTPUT}
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} ${INPUT} failed: ${result}")
+endif()
+if(UPDATE)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${OUTPUT} ${GOLDEN})
+    message(STATUS "Wrote ${GOLDEN}")
+    return()
+endif()
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUTPUT} ${GOLDEN}
+                RESULT_VARIABLE differs)
+if(differs)
+    message(FATAL_ERROR "${OUTPUT} differs from ${GOLDEN}; diff them, and if "
+                        "the change is intended rerun with "
+                        "-DPELOMON_UPDATE_GOLDEN=ON")
+endif()
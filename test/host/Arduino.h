@@ -0,0 +1,138 @@
+/* Host stand-in for the Arduino core, just enough of it to build the
+ * PeloMon parsing and ride pipeline with g++. The clock is virtual: it only
+ * moves when the test calls host_advance_us(), so a run is deterministic.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define HEX 16
+#define DEC 10
+#define LED_BUILTIN 13
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+#define A4 22
+#define A5 23
+#define F_CPU 8000000UL
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) NOT_AN_INTERRUPT
+
+#define bit(b) (1UL << (b))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define _BV(b) (1 << (b))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define noInterrupts()
+#define interrupts()
+#define cli()
+#define sei()
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*) PSTR(s))
+
+inline uint16_t word(uint8_t h, uint8_t l) { return (h << 8) | l; }
+
+// Virtual clock
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void host_advance_us(unsigned long us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t irq, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t irq);
+char* dtostrf(double value, signed char width, unsigned char prec, char* out);
+
+class Print {
+    public:
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t len);
+    size_t write(const char* str) { return write((const uint8_t*) str, strlen(str)); }
+    size_t write(const char* buf, size_t len) { return write((const uint8_t*) buf, len); }
+    virtual int availableForWrite(void) { return 0; }
+    size_t print(const __FlashStringHelper* str);
+    size_t print(const char* str);
+    size_t print(char c);
+    size_t print(unsigned char n, int base = DEC);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t println(void);
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+    template <typename T> size_t println(const T& value, int base) { return print(value, base) + println(); }
+};
+
+class Stream : public Print {
+    protected:
+    unsigned long _timeout;
+    public:
+    Stream(): _timeout(1000) {}
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+    virtual void flush(void) {}
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout(void) { return _timeout; }
+    // Takes what is already buffered; nothing arrives while the clock is
+    // stopped, so waiting out the timeout would never help
+    size_t readBytes(char* buf, size_t len);
+    size_t readBytes(uint8_t* buf, size_t len) { return readBytes((char*) buf, len); }
+};
+
+/* USB serial. The test feeds input with feed() and chooses where output
+ * goes; with no output file it is discarded, as with no USB host.
+ */
+class HostSerial : public Stream {
+    private:
+    uint8_t* rx;
+    size_t rx_len, rx_pos, rx_cap;
+    FILE* out;
+    public:
+    HostSerial(): rx(NULL), rx_len(0), rx_pos(0), rx_cap(0), out(NULL) {}
+    void begin(unsigned long baud) {}
+    operator bool() { return out != NULL; }
+    bool dtr(void) { return out != NULL; }
+    void set_output(FILE* file) { out = file; }
+    void feed(const uint8_t* buf, size_t len);
+    size_t write(uint8_t c);
+    using Print::write;
+    int availableForWrite(void) { return out != NULL ? 64 : 0; }
+    int available(void) { return rx_len - rx_pos; }
+    int read(void) { return rx_pos < rx_len ? rx[rx_pos++] : -1; }
+    int peek(void) { return rx_pos < rx_len ? rx[rx_pos] : -1; }
+};
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,44 @@
+/* Host stand-in for the Arduino EEPROM library: 1KB in RAM, erased (0xFF)
+ * at startup like a new 32u4.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+#include <Arduino.h>
+
+#define HOST_EEPROM_LEN 1024
+
+struct EEPROMClass {
+    uint8_t cells[HOST_EEPROM_LEN];
+    // Cells actually rewritten, to see what a change costs in wear
+    unsigned long writes;
+
+    EEPROMClass(): writes(0) { memset(cells, 0xFF, HOST_EEPROM_LEN); }
+    uint8_t read(int address) { return cells[address % HOST_EEPROM_LEN]; }
+    void write(int address, uint8_t value) {
+        cells[address % HOST_EEPROM_LEN] = value;
+        writes++;
+    }
+    void update(int address, uint8_t value) {
+        if (read(address) != value) write(address, value);
+    }
+    uint16_t length(void) { return HOST_EEPROM_LEN; }
+    template <typename T> T& get(int address, T& value) {
+        uint8_t* bytes = (uint8_t*) &value;
+        for (size_t i = 0; i < sizeof(T); i++) bytes[i] = read(address + i);
+        return value;
+    }
+    template <typename T> const T& put(int address, const T& value) {
+        const uint8_t* bytes = (const uint8_t*) &value;
+        for (size_t i = 0; i < sizeof(T); i++) update(address + i, bytes[i]);
+        return value;
+    }
+};
+extern EEPROMClass EEPROM;
+#endif
@@ -0,0 +1,28 @@
+/* Host stand-in for SoftwareSerial. Nothing is wired to the Peloton pins
+ * on the host, so the ports never receive; tests use the simulator.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef HOST_SOFTWARE_SERIAL_H
+#define HOST_SOFTWARE_SERIAL_H
+#include <Arduino.h>
+
+class SoftwareSerial : public Stream {
+    public:
+    SoftwareSerial(uint8_t rx_pin, uint8_t tx_pin, bool inverse = false) {}
+    void begin(long baud) {}
+    bool listen(void) { return true; }
+    bool isListening(void) { return true; }
+    bool overflow(void) { return false; }
+    size_t write(uint8_t c) { return 1; }
+    using Print::write;
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    int peek(void) { return -1; }
+};
+#endif
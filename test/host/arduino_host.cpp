@@ -0,0 +1,87 @@
+/* Host implementation of the Arduino core stand-ins in Arduino.h.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+
+HostSerial Serial;
+EEPROMClass EEPROM;
+
+// Kept in 32 bits like the 32u4's counters
+static uint32_t clock_us;
+static uint32_t clock_ms;
+static uint32_t clock_us_into_ms;
+
+void host_advance_us(unsigned long us) {
+    clock_us += us;
+    clock_us_into_ms += us;
+    clock_ms += clock_us_into_ms / 1000;
+    clock_us_into_ms %= 1000;
+}
+unsigned long millis(void) { return clock_ms; }
+unsigned long micros(void) { return clock_us; }
+void delay(unsigned long ms) { host_advance_us(ms * 1000); }
+void delayMicroseconds(unsigned int us) { host_advance_us(us); }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t level) {}
+int digitalRead(uint8_t pin) { return LOW; }
+void attachInterrupt(uint8_t irq, void (*isr)(void), int mode) {}
+void detachInterrupt(uint8_t irq) {}
+
+char* dtostrf(double value, signed char width, unsigned char prec, char* out) {
+    sprintf(out, "%*.*f", width, prec, value);
+    return out;
+}
+
+size_t Print::write(const uint8_t* buf, size_t len) {
+    size_t written = 0;
+    while (len--) written += write(*buf++);
+    return written;
+}
+size_t Print::print(const __FlashStringHelper* str) {
+    return write((const char*) str);
+}
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t) c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long) n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long) n, base); }
+size_t Print::print(int n, int base) { return print((long) n, base); }
+size_t Print::print(long n, int base) {
+    if (base == DEC && n < 0) return print('-') + print((unsigned long) -n, base);
+    return print((unsigned long) n, base);
+}
+size_t Print::print(unsigned long n, int base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+    return write(buf);
+}
+size_t Print::println(void) { return write('\n'); }
+
+size_t Stream::readBytes(char* buf, size_t len) {
+    size_t n = 0;
+    while (n < len && available() > 0) buf[n++] = (char) read();
+    return n;
+}
+
+void HostSerial::feed(const uint8_t* buf, size_t len) {
+    if (rx_pos == rx_len) rx_pos = rx_len = 0;
+    if (rx_len + len > rx_cap) {
+        rx_cap = (rx_len + len) * 2;
+        rx = (uint8_t*) realloc(rx, rx_cap);
+    }
+    memcpy(rx + rx_len, buf, len);
+    rx_len += len;
+}
+
+size_t HostSerial::write(uint8_t c) {
+    if (out == NULL) return 0;
+    fputc(c, out);
+    return 1;
+}
@@ -0,0 +1,33 @@
+/* Host stand-in for avr/pgmspace.h: flash and RAM are one address space.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*) (p))
+#define pgm_read_word(p) (*(const uint16_t*) (p))
+#define pgm_read_dword(p) (*(const uint32_t*) (p))
+#define pgm_read_ptr(p) (*(void* const*) (p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define snprintf_P snprintf
+#define sprintf_P sprintf
+#define vsnprintf_P vsnprintf
+#endif
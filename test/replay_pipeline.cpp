@@ -0,0 +1,186 @@
+/* Host build of the PeloMon ride pipeline, for golden-file regression tests.
+ *
+ * Plays a replay file (tools/replay.py --write) through the real simulator
+ * replay path, framing, message parsing, RideStatus and the CP/CSC packers
+ * on a virtual clock. The simulator releases each byte at its recorded
+ * time, so the sketch's loop sees the bus as it was. Prints one line per BLE update with the exact
+ * measurement payloads the firmware would set, then a summary. The same
+ * input always gives byte-identical output.
+ *
+ * Part of the PeloMon project. See the accompanying blog post at
+ * https://ihaque.org/posts/2021/01/04/pelomon-part-iv-software/
+ *
+ * Copyright 2020 Imran S Haque (imran@ihaque.org)
+ * Licensed under the CC-BY-NC 4.0 license
+ * (https://creativecommons.org/licenses/by-nc/4.0/).
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "settings.h"
+#include "Adafruit_BLE.h"
+
+uint8_t LOG_LEVEL;
+
+#include "logger.h"
+#include "binlog.h"
+#include "trace.h"
+#include "BLECyclingGatt.h"
+#include "resistance_lut.h"
+#include "peloton.h"
+#include "RideStatus.h"
+#include "update_scheduler.h"
+
+// receive_message_pair() waits this long for each bike byte
+#define HOST_BIKE_TIMEOUT_US 11000
+// How often the bike wait checks for a byte
+#define HOST_POLL_US 50
+// A loop() pass with nothing to read
+#define HOST_IDLE_US 1000
+// Setting the GATT characteristics on a BLE update
+#define HOST_BLE_UPDATE_US 15000
+// Keep running after the last record so periodic updates show up
+#define HOST_TAIL_MILLIS 2000
+
+Logger logger;
+PelotonProxy peloton;
+RideStatus ride_status(logger);
+ResistanceLUT resistance_lut(logger);
+UpdateScheduler ble_scheduler;
+
+uint8_t hu_buf[HU_MSG_BUF_LEN];
+uint8_t bike_buf[BIKE_MSG_BUF_LEN];
+uint8_t hu_buf_bytes;
+uint8_t bike_buf_bytes;
+uint8_t running_checksum;
+
+unsigned long pairs, valid_pairs, bike_timeouts, updates;
+
+/* receive_message_pair() and process_message_pair() from pelomon.ino with
+ * the hardware, stats and logging hooks taken out. Reads are free; time
+ * passes waiting for bytes and on BLE updates. Keep the control flow in
+ * step with the sketch.
+ */
+bool receive_message_pair(void) {
+    bool hu_message_complete = false, bike_message_complete = false;
+    peloton.hu_listen();
+    if (peloton.hu_available() == 0) return false;
+
+    while (peloton.hu_available()) {
+        if (frame_hu_byte(peloton.hu_read(), hu_buf, hu_buf_bytes,
+                          running_checksum) & FRAME_COMPLETE) {
+            peloton.bike_listen();
+            hu_message_complete = true;
+            break;
+        }
+    }
+
+    while (!bike_message_complete) {
+        unsigned long waited = 0;
+        while (!peloton.bike_available()) {
+            if (waited >= HOST_BIKE_TIMEOUT_US) {
+                if (hu_message_complete) bike_timeouts++;
+                return false;
+            }
+            host_advance_us(HOST_POLL_US);
+            waited += HOST_POLL_US;
+        }
+        if (frame_bike_byte(peloton.bike_read(), bike_buf, bike_buf_bytes,
+                            running_checksum) & FRAME_COMPLETE) {
+            peloton.hu_listen();
+            bike_message_complete = true;
+        }
+    }
+    return hu_message_complete && bike_message_complete;
+}
+
+void print_hex(const uint8_t* data, const uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) printf("%02x", data[i]);
+}
+
+void process_message_pair(void) {
+    HUMessage hu_msg(hu_buf, hu_buf_bytes);
+    BikeMessage bike_msg(bike_buf, bike_buf_bytes);
+    pairs++;
+
+    if (hu_msg.is_valid && bike_msg.is_valid) {
+        valid_pairs++;
+        if (hu_msg.packet_type == READ_RESISTANCE_TABLE) {
+            resistance_lut.update_entry(bike_msg.value, hu_msg.request);
+            if (hu_msg.request == 0x1E) resistance_lut.sync_to_eeprom();
+        } else if (bike_msg.request == BIKE_ID ||
+                   hu_msg.packet_type == STARTUP_UNKNOWN) {
+            // Do nothing on the two startup packets
+        } else {
+            ride_status.update(bike_msg, resistance_lut);
+            ble_scheduler.note_bike_message(bike_msg.request);
+        }
+    }
+
+    const unsigned long current_time = millis();
+    if (ble_scheduler.update_due(current_time)) {
+        ble_scheduler.mark_updated(current_time);
+        uint8_t data[11];
+        printf("%8lu cp ", current_time);
+        print_hex(data, BLECyclingPower::pack_cp_measurement(
+            data, ride_status.current_watts(), ride_status.total_kj()));
+        printf(" csc ");
+        print_hex(data, BLECyclingPower::pack_csc_measurement(
+            data, ride_status.integral_crank_revolutions(),
+            ride_status.last_crank_rev_ts_millis(),
+            ride_status.integral_wheel_revolutions(),
+            ride_status.last_wheel_rev_ts_millis()));
+        printf(" res %u\n", ride_status.resistance());
+        updates++;
+        host_advance_us(HOST_BLE_UPDATE_US);
+    }
+
+    memset(hu_buf, 0, HU_MSG_BUF_LEN);
+    memset(bike_buf, 0, BIKE_MSG_BUF_LEN);
+    running_checksum = 0;
+    hu_buf_bytes = bike_buf_bytes = 0;
+}
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-v")) {
+            LOG_LEVEL = LOG_LEVEL_DEBUG;
+            Serial.set_output(stderr);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: %s [-v] session.replay\n", argv[0]);
+        return 2;
+    }
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return 2;
+    }
+    static uint8_t input[1 << 20];
+    const size_t input_len = fread(input, 1, sizeof(input), f);
+    fclose(f);
+
+    peloton.initialize(false, true);
+    resistance_lut.initialize();
+    ride_status.initialize();
+    ble_scheduler.initialize();
+
+    // replay.py writes everything at once and USB flow control holds it
+    // back until the simulator takes each record
+    Serial.feed(input, input_len);
+    unsigned long tail_start = 0;
+    while (Serial.available() > 0 || millis() - tail_start < HOST_TAIL_MILLIS) {
+        if (Serial.available() > 0) tail_start = millis();
+        if (receive_message_pair()) process_message_pair();
+        else host_advance_us(HOST_IDLE_US);
+        logger.poll(true);
+    }
+    printf("records %lu pairs %lu valid %lu bike timeouts %lu updates %lu "
+           "eeprom writes %lu\n", (unsigned long) (input_len / REPLAY_RECORD_LEN),
+           pairs, valid_pairs, bike_timeouts, updates, EEPROM.writes);
+    return 0;
+}
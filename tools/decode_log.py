@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+# Render PeloMon deferred log records (see pelomon/binlog.h) as text
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+#
+# Requires pyelftools (pip install pyelftools).
+
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+from decode_telemetry import PAYLOADS, crc16_xmodem, parse_frame_at
+
+LOG_SYNC = b'\xa5\x5c'
+TELEMETRY_SYNC = b'\xa5\x5a'
+LOG_HEADER = struct.Struct('<2sBH')
+
+# avr-gcc sizes: int is 16 bits
+CONVERSION = re.compile(r'%([-+ 0#]*\d*(?:\.\d+)?)(hh|h|l)?([diouxXc%])')
+SIZES = {'hh': 1, 'h': 2, None: 2, 'l': 4}
+UNSIGNED = {1: 'B', 2: 'H', 4: 'I'}
+SIGNED = {1: 'b', 2: 'h', 4: 'i'}
+
+
+class FormatTable(object):
+    """Format strings looked up by flash address in the firmware .elf."""
+
+    def __init__(self, elf_path):
+        self.sections = []
+        self.cache = {}
+        with open(elf_path, 'rb') as f:
+            elf = ELFFile(f)
+            for section in elf.iter_sections():
+                # Flash-resident sections; .data etc. sit at 0x800000+
+                if section['sh_type'] == 'SHT_PROGBITS' and \
+                        section['sh_addr'] < 0x800000 and \
+                        section['sh_flags'] & 0x2:
+                    self.sections.append((section['sh_addr'], section.data()))
+
+    def lookup(self, address):
+        if address not in self.cache:
+            self.cache[address] = self._read(address)
+        return self.cache[address]
+
+    def _read(self, address):
+        for base, data in self.sections:
+            if base <= address < base + len(data):
+                end = data.index(b'\0', address - base)
+                return data[address - base:end].decode('ascii', 'replace')
+        return None
+
+
+def render(fmt, args):
+    """Apply a printf format to raw little-endian AVR argument bytes."""
+    out = []
+    offset = 0
+    pos = 0
+    for match in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:match.start()])
+        pos = match.end()
+        flags, modifier, conversion = match.groups()
+        if conversion == '%':
+            out.append('%')
+            continue
+        size = 1 if conversion == 'c' else SIZES[modifier]
+        code = (SIGNED if conversion in 'di' else UNSIGNED)[size]
+        value, = struct.unpack_from('<' + code, args, offset)
+        offset += size
+        if conversion == 'c':
+            out.append(chr(value))
+        else:
+            out.append(('%' + flags + conversion.replace('u', 'd')) % value)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def decode(stream, formats):
+    """Yield text for a capture mixing plain text, log records and telemetry."""
+    offset = 0
+    while offset < len(stream):
+        log_at = stream.find(LOG_SYNC, offset)
+        telem_at = stream.find(TELEMETRY_SYNC, offset)
+        candidates = [i for i in (log_at, telem_at) if i >= 0]
+        start = min(candidates) if candidates else len(stream)
+        if start > offset:
+            yield stream[offset:start].decode('ascii', 'replace')
+        if start == len(stream):
+            return
+        if start == telem_at:
+            frame = parse_frame_at(stream, start)
+            if frame is None:
+                yield stream[start:start + 1].decode('latin-1')
+                offset = start + 1
+                continue
+            version, fields, offset = frame
+            yield 'TELEMETRY %s\n' % ' '.join(
+                '%s=%s' % (name, fields[name]) for name in PAYLOADS[version][1])
+            continue
+        if start + LOG_HEADER.size > len(stream):
+            return
+        _, args_len, address = LOG_HEADER.unpack_from(stream, start)
+        end = start + LOG_HEADER.size + args_len
+        if end + 2 > len(stream) or \
+                crc16_xmodem(stream[start:end]) != \
+                struct.unpack_from('<H', stream, end)[0]:
+            # Not a record after all
+            yield stream[start:start + 1].decode('latin-1')
+            offset = start + 1
+            continue
+        fmt = formats.lookup(address)
+        args = stream[start + LOG_HEADER.size:end]
+        if fmt is None:
+            yield '<unknown format 0x%04x: %s>\n' % (address, args.hex())
+        else:
+            yield render(fmt, args)
+        offset = end + 2
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Render PeloMon deferred log records as text, using the '
+                    'format strings in the firmware .elf from the same build.')
+    parser.add_argument('elf', help='firmware .elf of the running build '
+                        '(e.g. from arduino-cli compile --output-dir)')
+    parser.add_argument('capture', nargs='?', type=argparse.FileType('rb'),
+                        default=getattr(sys.stdin, 'buffer', sys.stdin))
+    args = parser.parse_args()
+
+    formats = FormatTable(args.elf)
+    for text in decode(args.capture.read(), formats):
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+# Decode PeloMon binary telemetry frames (see pelomon/telemetry.h) to CSV
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+
+import argparse
+import struct
+import sys
+
+SYNC = b'\xa5\x5a'
+HEADER = struct.Struct('<2sBB')
+CRC = struct.Struct('<H')
+PAYLOADS = {
+    1: (struct.Struct('<BIHHHBHII'),
+        ('seq', 'timestamp_ms', 'rpm', 'deciwatts', 'raw_resistance',
+         'resistance', 'crank_revs', 'wheel_revs', 'energy_j')),
+}
+
+
+def crc16_xmodem(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def parse_frame_at(stream, offset):
+    """Return (version, dict, end offset) for a valid frame at offset, else None."""
+    if stream[offset:offset + len(SYNC)] != SYNC or \
+            offset + HEADER.size > len(stream):
+        return None
+    _, version, length = HEADER.unpack_from(stream, offset)
+    end = offset + HEADER.size + length
+    if version not in PAYLOADS or PAYLOADS[version][0].size != length \
+            or end + CRC.size > len(stream):
+        return None
+    crc, = CRC.unpack_from(stream, end)
+    if crc != crc16_xmodem(stream[offset:end]):
+        return None
+    layout, fields = PAYLOADS[version]
+    values = layout.unpack_from(stream, offset + HEADER.size)
+    return version, dict(zip(fields, values)), end + CRC.size
+
+
+def parse_frames(stream):
+    """Yield (version, dict) for each valid frame in a byte string.
+
+    Text log output may be interleaved with frames, so resynchronize on
+    the sync bytes and drop anything that fails the length or CRC check.
+    """
+    offset = 0
+    while True:
+        offset = stream.find(SYNC, offset)
+        if offset < 0:
+            return
+        frame = parse_frame_at(stream, offset)
+        if frame is None:
+            offset += 1
+            continue
+        version, fields, offset = frame
+        yield version, fields
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode PeloMon binary telemetry frames to CSV')
+    parser.add_argument('input', nargs='?', default='-',
+                        help='capture file, or - for stdin (default)')
+    args = parser.parse_args()
+    if args.input == '-':
+        stream = sys.stdin.buffer.read()
+    else:
+        with open(args.input, 'rb') as infile:
+            stream = infile.read()
+
+    fields = PAYLOADS[max(PAYLOADS)][1]
+    print(','.join(('version',) + fields))
+    for version, frame in parse_frames(stream):
+        print(','.join([str(version)] + [str(frame.get(f, '')) for f in fields]))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,154 @@
+#!/usr/bin/env python
+# Download PeloMon ride history over the BLE UART (see pelomon/ride_history.h)
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+#
+# Requires bleak (pip install bleak).
+
+import argparse
+import asyncio
+import struct
+import sys
+
+from bleak import BleakClient, BleakScanner
+
+from decode_telemetry import crc16_xmodem
+
+UART_RX_CHAR = '6e400002-b5a3-f393-e0a9-e50e24dcca9e'
+UART_TX_CHAR = '6e400003-b5a3-f393-e0a9-e50e24dcca9e'
+
+SYNC = 0xa6
+ACK = 0x06
+NAK = 0x15
+CANCEL = 0x18
+FRAME_LEN = 16
+HEADER = struct.Struct('<BBHHBB')
+SAMPLES = {
+    1: (struct.Struct('<HBB'), ('watts', 'rpm', 'resistance')),
+}
+
+
+class HistoryReceiver(object):
+    """Reassemble in-order history frames and decide what to acknowledge."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.expected = 0
+        self.header = None
+        self.payload = bytearray()
+        self.nak_sent_for = None
+
+    @property
+    def num_frames(self):
+        if self.header is None:
+            return None
+        count, _, sample_len, _ = self.header
+        per_frame = (FRAME_LEN - 4) // sample_len
+        return 1 + (count + per_frame - 1) // per_frame
+
+    @property
+    def done(self):
+        return self.header is not None and self.expected == self.num_frames
+
+    def feed(self, data):
+        """Consume notification bytes; return a reply for the firmware."""
+        self.buf.extend(data)
+        progressed = duplicate = gap = False
+        while len(self.buf) >= FRAME_LEN:
+            if self.buf[0] != SYNC:
+                del self.buf[0]
+                continue
+            frame = bytes(self.buf[:FRAME_LEN])
+            crc, = struct.unpack('<H', frame[-2:])
+            if crc16_xmodem(frame[:-2]) != crc:
+                # Interleaved text or corruption: resync
+                del self.buf[0]
+                continue
+            del self.buf[:FRAME_LEN]
+            ahead = (frame[1] - self.expected) & 0xff
+            if ahead >= 0x80:
+                # Resent after a lost ACK: acknowledge again
+                duplicate = True
+                continue
+            if ahead:
+                gap = True
+                continue
+            if self.expected == 0:
+                self.header = HEADER.unpack(frame[:HEADER.size])[2:]
+            else:
+                self.payload.extend(frame[2:-2])
+            self.expected += 1
+            progressed = True
+        if progressed or duplicate:
+            self.nak_sent_for = None
+            return bytes([ACK, (self.expected - 1) & 0xff])
+        if gap and self.nak_sent_for != self.expected:
+            # One NAK per gap; the firmware's timeout covers lost NAKs
+            self.nak_sent_for = self.expected
+            return bytes([NAK, self.expected & 0xff])
+        return None
+
+    def samples(self):
+        count, interval, sample_len, version = self.header
+        fmt, fields = SAMPLES[version]
+        for i in range(count):
+            values = fmt.unpack_from(self.payload, i * sample_len)
+            row = dict(zip(fields, values))
+            row['seconds'] = i * interval / 1000.
+            yield row
+
+
+async def fetch(address, name, timeout):
+    if address is None:
+        device = await BleakScanner.find_device_by_name(name, timeout=timeout)
+        if device is None:
+            raise SystemExit('No device named %s found' % name)
+        address = device.address
+    receiver = HistoryReceiver()
+    finished = asyncio.Event()
+    async with BleakClient(address) as client:
+        async def reply(data):
+            await client.write_gatt_char(UART_RX_CHAR, data)
+
+        def on_notify(_, data):
+            response = receiver.feed(data)
+            if response is not None:
+                asyncio.ensure_future(reply(response))
+            if receiver.done:
+                finished.set()
+
+        await client.start_notify(UART_TX_CHAR, on_notify)
+        await reply(b'hist\n')
+        try:
+            await asyncio.wait_for(finished.wait(), timeout)
+        except asyncio.TimeoutError:
+            await reply(bytes([CANCEL, 0]))
+            raise SystemExit('Transfer timed out after %d frames'
+                             % receiver.expected)
+        await client.stop_notify(UART_TX_CHAR)
+    return receiver
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Download ride history from a PeloMon over BLE as CSV.')
+    parser.add_argument('--address', help='BLE address (default: scan by name)')
+    parser.add_argument('--name', default='PeloMon')
+    parser.add_argument('--timeout', type=float, default=30.)
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'),
+                        default=sys.stdout)
+    args = parser.parse_args()
+
+    receiver = asyncio.run(fetch(args.address, args.name, args.timeout))
+    _, fields = SAMPLES[receiver.header[3]]
+    columns = ('seconds',) + fields
+    args.output.write(','.join(columns) + '\n')
+    for row in receiver.samples():
+        args.output.write(','.join(str(row[col]) for col in columns) + '\n')
+
+
+if __name__ == '__main__':
+    main()
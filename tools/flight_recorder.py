@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+# Decode PeloMon flight recorder dumps (see pelomon/flight_recorder.h)
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+
+import argparse
+import struct
+import sys
+
+from decode_telemetry import crc16_xmodem
+
+SYNC = b'\xa5\x5d'
+HEADER = struct.Struct('<2sBH')
+ENTRY_HEADER = struct.Struct('<BBI')
+CRC = struct.Struct('<H')
+VALID_HU = 0x01
+VALID_BIKE = 0x02
+BIKE_TIMEOUT = 0x04
+
+
+def parse_dumps(stream):
+    """Yield a list of (micros, flags, hu_bytes, bike_bytes) per valid dump."""
+    offset = 0
+    while True:
+        start = stream.find(SYNC, offset)
+        if start < 0 or start + HEADER.size > len(stream):
+            return
+        _, count, length = HEADER.unpack_from(stream, start)
+        end = start + HEADER.size + length
+        if end + CRC.size > len(stream) or \
+                crc16_xmodem(stream[start:end]) != \
+                CRC.unpack_from(stream, end)[0]:
+            offset = start + 1
+            continue
+        entries = []
+        pos = start + HEADER.size
+        for _ in range(count):
+            flags, lens, micros = ENTRY_HEADER.unpack_from(stream, pos)
+            pos += ENTRY_HEADER.size
+            hu_len, bike_len = lens >> 4, lens & 0x0F
+            hu = stream[pos:pos + hu_len]
+            bike = stream[pos + hu_len:pos + hu_len + bike_len]
+            pos += hu_len + bike_len
+            entries.append((micros, flags, hu, bike))
+        yield entries
+        offset = end + CRC.size
+
+
+def describe(flags):
+    if flags & BIKE_TIMEOUT:
+        return 'TIMEOUT'
+    return '%s/%s' % ('ok' if flags & VALID_HU else 'BAD',
+                      'ok' if flags & VALID_BIKE else 'BAD')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode PeloMon flight recorder dumps (output of the frec '
+                    'command) from a log capture.')
+    parser.add_argument('capture', nargs='?', type=argparse.FileType('rb'),
+                        default=getattr(sys.stdin, 'buffer', sys.stdin))
+    parser.add_argument('--bin', type=argparse.FileType('wb'),
+                        help='also write the raw frames, HU then bike, in the '
+                             'format of the peloton_decoding/*.bin captures')
+    args = parser.parse_args()
+
+    for dump, entries in enumerate(parse_dumps(args.capture.read())):
+        print('# dump %d: %d message pairs' % (dump, len(entries)))
+        first = entries[0][0] if entries else 0
+        for micros, flags, hu, bike in entries:
+            # Relative to the oldest entry; micros() wraps every ~71 minutes
+            print('%10.3f ms  %-7s  HU %-11s  bike %s' % (
+                ((micros - first) & 0xFFFFFFFF) / 1000.0, describe(flags),
+                hu.hex(), bike.hex()))
+            if args.bin is not None:
+                args.bin.write(hu + bike)
+
+
+if __name__ == '__main__':
+    main()
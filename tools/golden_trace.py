@@ -0,0 +1,366 @@
+#!/usr/bin/env python
+# Golden-trace regression check of the PeloMon ride pipeline on hardware
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+#
+# Requires pyserial (pip install pyserial).
+
+import argparse
+import bisect
+import json
+import os
+import struct
+import sys
+import threading
+import time
+
+import serial
+
+from decode_telemetry import crc16_xmodem
+from replay import enter_replay, load_schedule, records, send_records
+
+# GATT trace frames: see send_gatt_trace in pelomon/telemetry.h
+SYNC = b'\xa5\x5e'
+HEADER = struct.Struct('<2sBB')
+CRC = struct.Struct('<H')
+VERSION = 1
+CP_MEASUREMENT = struct.Struct('<HhH')      # flags, watts, energy kJ
+CSC_MEASUREMENT = struct.Struct('<BIHHH')  # flags, wheel revs, wheel event
+                                           # time, crank revs, crank event time
+# pelomon/peloton.h
+RESISTANCE_LUT_DELTAS = (
+    164, 5, 17, 36, 75, 72, 71, 57,
+    61, 51, 44, 34, 39, 31, 26, 20,
+    24, 18, 16, 13, 15, 12, 10, 10,
+    9, 8, 6, 8, 6, 5, 4)
+RPM, POWER, RESISTANCE = 0x41, 0x44, 0x4A
+BIKE_ID, INIT_REQUEST = 0xFB, 0xFE
+
+
+def hu_frame(kind, request):
+    return bytes((kind, request, (kind + request) & 0xFF, 0xF6))
+
+
+def bike_frame(request, value, digits):
+    # ASCII digits, least significant first, as the bike sends them
+    body = bytes((0xF1, request, digits)) + bytes(
+        0x30 + (value // 10 ** i) % 10 for i in range(digits))
+    return body + bytes((sum(body) & 0xFF, 0xF6))
+
+
+def riding(seconds, rpm, deciwatts, resistance):
+    """HU/bike frames for the RPM/power/resistance rotation at 100ms each.
+
+    rpm and deciwatts may be callables of the elapsed fraction, for ramps.
+    """
+    frames = []
+    cycles = int(seconds * 10 / 3)
+    for i in range(cycles):
+        fraction = float(i) / cycles
+        cadence = rpm(fraction) if callable(rpm) else rpm
+        power = deciwatts(fraction) if callable(deciwatts) else deciwatts
+        frames += [hu_frame(0xF5, RPM), bike_frame(RPM, int(cadence), 3),
+                   hu_frame(0xF5, POWER), bike_frame(POWER, int(power), 5),
+                   hu_frame(0xF5, RESISTANCE),
+                   bike_frame(RESISTANCE, resistance, 4)]
+    return frames
+
+
+def corrupt(frames, every):
+    """Damage every Nth bike frame, rotating through the ways it goes wrong."""
+    out = []
+    damaged = 0
+    for index, frame in enumerate(frames):
+        if frame[0] != 0xF1 or index % every:
+            out.append(frame)
+            continue
+        kind = damaged % 4
+        damaged += 1
+        frame = bytearray(frame)
+        if kind == 0:
+            frame[-2] ^= 0x55             # bad checksum
+        elif kind == 1:
+            frame[3] = ord('A')           # non-digit payload, checksum fixed up
+            frame[-2] = sum(frame[:-2]) & 0xFF
+        elif kind == 2:
+            frame[-1] = 0x00              # bad terminator
+        else:
+            continue                      # bike didn't answer
+        out.append(bytes(frame))
+    return out
+
+
+def canned_session():
+    """Raw HU+bike stream, replayed at 100ms per pair.
+
+    Boot with all 31 resistance table entries, steady riding, a ramp,
+    riding through corrupt frames, stopping pedalling, the bike going
+    silent for over 5s, and riding again.
+    """
+    frames = [hu_frame(0xFE, 0x00), bike_frame(INIT_REQUEST, 0, 3),
+              hu_frame(0xF5, BIKE_ID), bike_frame(BIKE_ID, 0, 7)]
+    raw = 0
+    for entry, delta in enumerate(RESISTANCE_LUT_DELTAS):
+        raw += delta
+        frames += [hu_frame(0xF7, entry), bike_frame(0xF7, raw, 4)]
+    frames += riding(30, 80, 1500, 456)
+    frames += riding(20, lambda f: 70 + 25 * f, lambda f: 1000 + 1500 * f, 520)
+    frames += corrupt(riding(15, 85, 1800, 520), 7)
+    frames += riding(7, 0, 0, 520)
+    frames += [hu_frame(0xF5, (RPM, POWER, RESISTANCE)[i % 3])
+               for i in range(60)]
+    frames += riding(15, 90, 2000, 600)
+    return b''.join(frames)
+
+
+def parse_trace_frames(stream):
+    """Yield (end offset, timestamp_ms, cp bytes, csc bytes) per valid frame."""
+    offset = 0
+    while True:
+        offset = stream.find(SYNC, offset)
+        if offset < 0 or offset + HEADER.size > len(stream):
+            return
+        _, version, length = HEADER.unpack_from(stream, offset)
+        end = offset + HEADER.size + length
+        if version != VERSION or end + CRC.size > len(stream) or \
+                CRC.unpack_from(stream, end)[0] != \
+                crc16_xmodem(stream[offset:end]):
+            offset += 1
+            continue
+        body = stream[offset + HEADER.size:end]
+        timestamp, cp_len = struct.unpack_from('<IB', body)
+        cp = body[5:5 + cp_len]
+        csc_len = body[5 + cp_len]
+        csc = body[6 + cp_len:6 + cp_len + csc_len]
+        yield end + CRC.size, timestamp, cp, csc
+        offset = end + CRC.size
+
+
+class Capture(object):
+    """Reads the device's output, remembering when each chunk arrived."""
+
+    def __init__(self, port):
+        self.port = port
+        self.data = bytearray()
+        self.chunk_ends = []
+        self.chunk_times = []
+        self.thread = threading.Thread(target=self.run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def run(self):
+        while self.port.is_open:
+            try:
+                data = self.port.read(self.port.in_waiting or 1)
+            except (serial.SerialException, TypeError):
+                return
+            if data:
+                self.data += data
+                self.chunk_ends.append(len(self.data))
+                self.chunk_times.append(time.time())
+
+    def frames(self, start):
+        """Trace frames as dicts, timed from start by arrival on the host."""
+        stream = bytes(self.data)
+        frames = []
+        for end, timestamp, cp, csc in parse_trace_frames(stream):
+            chunk = bisect.bisect_left(self.chunk_ends, end)
+            frames.append({'t': round(self.chunk_times[chunk] - start, 3),
+                           'ms': timestamp, 'cp': cp.hex(), 'csc': csc.hex()})
+        return frames
+
+
+def run_session(port_name, capture_path, period, enter):
+    schedule = load_schedule(capture_path, period)
+    if not schedule:
+        raise SystemExit('no bytes found in %s' % capture_path)
+    if enter:
+        enter_replay(port_name)
+    port = serial.Serial(port_name, 230400, timeout=0.1)
+    capture = Capture(port)
+    start = send_records(port, records(schedule))
+    # Let the last updates come back
+    time.sleep(1.5)
+    port.close()
+    return capture.frames(start)
+
+
+def decode(frame):
+    cp_flags, watts, kj = CP_MEASUREMENT.unpack(bytes.fromhex(frame['cp']))
+    csc_flags, wheel_revs, wheel_time, crank_revs, crank_time = \
+        CSC_MEASUREMENT.unpack(bytes.fromhex(frame['csc']))
+    # Event times are in 1/1024s since boot, so compare their age at the
+    # time of the update instead
+    now = (frame['ms'] * 128 // 125) & 0xFFFF
+    return {'cp_flags': cp_flags, 'watts': watts, 'kj': kj,
+            'csc_flags': csc_flags, 'wheel_revs': wheel_revs,
+            'crank_revs': crank_revs,
+            'wheel_age_ms': ((now - wheel_time) & 0xFFFF) * 125 // 128,
+            'crank_age_ms': ((now - crank_time) & 0xFFFF) * 125 // 128}
+
+
+def significant(frames):
+    # With no fresh bike data the firmware re-sends the same payload every
+    # BT_UPDATE_MAX_INTERVAL_MILLIS, at a phase that varies run to run.
+    # Only frames that change something are compared.
+    kept = []
+    previous = None
+    for frame in frames:
+        payload = (frame['cp'], frame['csc'])
+        if frame['t'] >= 0 and payload != previous:
+            kept.append(frame)
+        previous = payload
+    return kept
+
+
+def compare(golden, actual, args):
+    """Return a list of differences between two frame lists."""
+    tolerances = {'kj': 1, 'crank_revs': args.rev_tolerance,
+                  'wheel_revs': args.rev_tolerance,
+                  'wheel_age_ms': args.age_tolerance,
+                  'crank_age_ms': args.age_tolerance}
+    problems = []
+    unmatched = significant(actual)
+    for expected in significant(golden):
+        near = [f for f in unmatched
+                if abs(f['t'] - expected['t']) <= args.window]
+        if not near:
+            problems.append('%8.3fs missing update %s' % (
+                expected['t'], json.dumps(decode(expected), sort_keys=True)))
+            continue
+        match = min(near, key=lambda f: abs(f['t'] - expected['t']))
+        unmatched.remove(match)
+        want, got = decode(expected), decode(match)
+        for field in sorted(want):
+            tolerance = tolerances.get(field, 0)
+            if field.endswith('_revs'):
+                # Revolutions are integrated over time, so drift with it
+                tolerance = max(tolerance, want[field] // 100)
+            if abs(want[field] - got[field]) > tolerance:
+                problems.append('%8.3fs %s: expected %d, got %d' % (
+                    expected['t'], field, want[field], got[field]))
+    for extra in unmatched:
+        problems.append('%8.3fs unexpected update %s' % (
+            extra['t'], json.dumps(decode(extra), sort_keys=True)))
+    return problems
+
+
+def read_bench(port_name):
+    """Run the bench command; return {label: min cycles or None if >65535}."""
+    with serial.Serial(port_name, 230400, timeout=3) as port:
+        port.reset_input_buffer()
+        port.write(b'bench\n')
+        # Returns once the port has been quiet for the timeout
+        lines = port.read(4096).decode('ascii', 'replace')
+    results = {}
+    in_table = False
+    for line in lines.splitlines():
+        fields = line.strip().split('\t')
+        if fields[0] == 'func':
+            in_table = True
+        elif in_table and len(fields) >= 2:
+            results[fields[0]] = None if fields[1] == '>65535' \
+                else int(fields[1])
+    return results
+
+
+def write_json(path, value):
+    with open(path, 'w') as f:
+        json.dump(value, f, indent=1, sort_keys=True)
+        f.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Regression checks against a PeloMon on USB serial. '
+                    '"session" writes a canned raw HU+bike stream. "payloads" '
+                    'replays a capture through the firmware in replay mode '
+                    'and compares the CP/CSC measurement bytes of every BLE '
+                    'update against a golden file. "bench" runs the bench '
+                    'command and compares cycle counts against a budget '
+                    'file. --record writes the golden or budget file from '
+                    'the current device instead of checking. Exits nonzero '
+                    'on any difference.')
+    commands = parser.add_subparsers(dest='command')
+    commands.required = True
+
+    session = commands.add_parser('session', help='write the canned session')
+    session.add_argument('output', help='.bin file to write')
+
+    payloads = commands.add_parser('payloads', help='check GATT payloads')
+    payloads.add_argument('port', help='USB serial port, e.g. /dev/ttyACM0')
+    payloads.add_argument('capture', help='session to replay (see replay.py)')
+    payloads.add_argument('golden', help='golden .json file')
+    payloads.add_argument('--record', action='store_true')
+    payloads.add_argument('--enter', action='store_true',
+                          help='send the replay command first')
+    payloads.add_argument('--period', type=float, default=0.1,
+                          help='seconds between pairs for raw streams')
+    payloads.add_argument('--window', type=float, default=0.1,
+                          help='seconds either side of a golden update to '
+                               'look for its match (default %(default)s)')
+    payloads.add_argument('--rev-tolerance', type=int, default=2,
+                          help='allowed difference in cumulative wheel and '
+                               'crank revolutions, or 1%% if larger (default '
+                               '%(default)s)')
+    payloads.add_argument('--age-tolerance', type=int, default=60,
+                          help='allowed difference in ms since the last '
+                               'wheel or crank event (default %(default)s)')
+
+    bench = commands.add_parser('bench', help='check cycle budgets')
+    bench.add_argument('port', help='USB serial port, e.g. /dev/ttyACM0')
+    bench.add_argument('budgets', help='budget .json file')
+    bench.add_argument('--record', action='store_true')
+    bench.add_argument('--margin', type=float, default=5,
+                       help='percent over budget allowed (default '
+                            '%(default)s)')
+    args = parser.parse_args()
+
+    if args.command == 'session':
+        with open(args.output, 'wb') as f:
+            f.write(canned_session())
+        return 0
+
+    if args.command == 'bench':
+        cycles = read_bench(args.port)
+        if not cycles:
+            raise SystemExit('no bench output from %s' % args.port)
+        if args.record:
+            write_json(args.budgets, cycles)
+            return 0
+        with open(args.budgets) as f:
+            budgets = json.load(f)
+        failed = 0
+        for label in sorted(budgets):
+            budget, got = budgets[label], cycles.get(label, 0)
+            over = budget is not None and (
+                got is None or got > budget * (1 + args.margin / 100.0))
+            if label not in cycles or over:
+                failed += 1
+            print('%-10s budget %6s got %6s%s' % (
+                label, budget, got if label in cycles else '-',
+                '  FAIL' if label not in cycles or over else ''))
+        return 1 if failed else 0
+
+    frames = run_session(args.port, args.capture, args.period, args.enter)
+    if args.record:
+        write_json(args.golden, {'capture': os.path.basename(args.capture),
+                                 'version': VERSION, 'frames': frames})
+        sys.stderr.write('Recorded %d updates (%d significant)\n' % (
+            len(frames), len(significant(frames))))
+        return 0
+    with open(args.golden) as f:
+        golden = json.load(f)
+    problems = compare(golden['frames'], frames, args)
+    for problem in problems:
+        print(problem)
+    print('%d significant updates checked, %d differences' % (
+        len(significant(golden['frames'])), len(problems)))
+    return 1 if problems else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
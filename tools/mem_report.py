@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+# Report static SRAM use of a PeloMon build against the 32u4's budget
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+#
+# Requires pyelftools (pip install pyelftools).
+
+import argparse
+import sys
+
+from elftools.elf.elffile import ELFFile
+from elftools.elf.sections import SymbolTableSection
+
+SRAM_BYTES = 2560
+# avr-gcc puts data memory at 0x800000 in the ELF address space
+DATA_OFFSET = 0x800000
+SRAM_SECTIONS = ('.data', '.bss', '.noinit')
+
+
+def static_usage(elf_path):
+    """Return ({section: size}, [(size, section, symbol)]) for SRAM."""
+    with open(elf_path, 'rb') as f:
+        elf = ELFFile(f)
+        sections = {}
+        for name in SRAM_SECTIONS:
+            section = elf.get_section_by_name(name)
+            if section is not None:
+                sections[name] = section['sh_size']
+        symbols = []
+        symtab = elf.get_section_by_name('.symtab')
+        if isinstance(symtab, SymbolTableSection):
+            for symbol in symtab.iter_symbols():
+                if symbol['st_info']['type'] != 'STT_OBJECT' or \
+                        symbol['st_size'] == 0 or \
+                        not isinstance(symbol['st_shndx'], int):
+                    continue
+                section = elf.get_section(symbol['st_shndx']).name
+                if section in SRAM_SECTIONS:
+                    symbols.append((symbol['st_size'], section, symbol.name))
+    symbols.sort(reverse=True)
+    return sections, symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='List the largest globals in a PeloMon build and check '
+                    'that static SRAM leaves enough room for the stack.')
+    parser.add_argument('elf', help='firmware .elf (e.g. from arduino-cli '
+                        'compile --output-dir)')
+    parser.add_argument('--stack-reserve', type=int, default=768,
+                        help='bytes that must stay free for stack and heap '
+                             '(default %(default)s; compare with the mem '
+                             'command\'s stack peak on a running unit)')
+    parser.add_argument('--top', type=int, default=20,
+                        help='number of symbols to list')
+    args = parser.parse_args()
+
+    sections, symbols = static_usage(args.elf)
+    total = sum(sections.values())
+    for size, section, name in symbols[:args.top]:
+        print('%6d  %-7s %s' % (size, section, name))
+    print()
+    for name in SRAM_SECTIONS:
+        if name in sections:
+            print('%-7s %6d' % (name, sections[name]))
+    budget = SRAM_BYTES - args.stack_reserve
+    print('static  %6d of %d budget (%d SRAM - %d stack reserve)' % (
+        total, budget, SRAM_BYTES, args.stack_reserve))
+    if total > budget:
+        print('OVER BUDGET by %d bytes' % (total - budget))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,253 @@
+#!/usr/bin/env python
+# Replay a recorded Peloton session into a PeloMon in replay mode
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+#
+# Requires pyserial (pip install pyserial).
+
+import argparse
+import struct
+import sys
+import threading
+import time
+
+import serial
+
+from flight_recorder import SYNC as FLIGHT_RECORDER_SYNC, parse_dumps
+from sigrok_timing import Capture, decode_uart
+
+# Record layout: see PelotonSimulator in pelomon/peloton.h
+REPLAY_SYNC = 0xA8
+REPLAY_FROM_BIKE = 0x01
+REPLAY_GAP_ONLY = 0x02
+RECORD = struct.Struct('<BBHB')
+MAX_GAP_US = 0xFFFF
+HU_STARTS = (0xF5, 0xF7, 0xFE)
+BIKE_START = 0xF1
+# One byte at 19200 baud 8N1
+BYTE_S = 10 / 19200.0
+# Only sigrok captures have byte timing. Elsewhere the HU polls at this
+# period and the bike starts answering after the median latency measured
+# by sigrok_timing.py.
+DEFAULT_PERIOD_S = 0.1
+BIKE_LATENCY_S = 0.0012
+# --fast shortens the idle time between pairs to this
+FAST_GAP_S = 0.02
+
+
+def split_raw(stream):
+    """Split a raw HU+bike byte stream (peloton_decoding/*.bin) into
+    (from_bike, is_frame, bytes) chunks.
+
+    Bytes outside any frame are kept, on the side of the frame before them.
+    """
+    offset = 0
+    unframed = 0
+    from_bike = False
+    while offset < len(stream):
+        start = stream[offset]
+        if start in HU_STARTS:
+            length = 4
+        elif start == BIKE_START and offset + 2 < len(stream):
+            length = stream[offset + 2] + 5
+        else:
+            offset += 1
+            continue
+        if unframed < offset:
+            yield from_bike, False, stream[unframed:offset]
+        from_bike = start == BIKE_START
+        yield from_bike, True, stream[offset:offset + length]
+        offset += length
+        unframed = offset
+    if unframed < len(stream):
+        yield from_bike, False, stream[unframed:]
+
+
+def place(schedule, when, from_bike, data):
+    """Schedule data back to back from when; return when the last byte ends."""
+    for byte in bytearray(data):
+        when += BYTE_S
+        schedule.append((when, from_bike, byte))
+    return when
+
+
+def schedule_from_raw(stream, period):
+    """[(time_s, from_bike, byte)] with one HU request per period."""
+    schedule = []
+    when = 0.0
+    polls = 0
+    for from_bike, is_frame, chunk in split_raw(stream):
+        if is_frame and not from_bike:
+            when = max(when, polls * period)
+            polls += 1
+        elif is_frame:
+            when += BIKE_LATENCY_S
+        when = place(schedule, when, from_bike, chunk)
+    return schedule
+
+
+def schedule_from_flight_recorder(stream):
+    schedule = []
+    for entries in parse_dumps(stream):
+        if not entries:
+            continue
+        first = entries[0][0]
+        offset = schedule[-1][0] + DEFAULT_PERIOD_S if schedule else 0.0
+        for micros, _, hu, bike in entries:
+            when = offset + ((micros - first) & 0xFFFFFFFF) / 1e6
+            # Entries can't overlap, whatever their timestamps say
+            if schedule:
+                when = max(when, schedule[-1][0])
+            when = place(schedule, when, False, hu)
+            if bike:
+                place(schedule, when + BIKE_LATENCY_S, True, bike)
+    return schedule
+
+
+def schedule_from_sigrok(path, hu_probe, bike_probe):
+    """Every decoded byte at the end of its stop bit, framed or not."""
+    capture = Capture(path)
+    rate = capture.samplerate
+    schedule = [(end / rate, False, byte) for _, end, byte in
+                decode_uart(capture.channel(hu_probe), rate)]
+    schedule += [(end / rate, True, byte) for _, end, byte in
+                 decode_uart(capture.channel(bike_probe), rate)]
+    schedule.sort()
+    return schedule
+
+
+def load_schedule(path, period=DEFAULT_PERIOD_S, hu_probe='D0',
+                  bike_probe='D4'):
+    if path.endswith('.sr'):
+        return schedule_from_sigrok(path, hu_probe, bike_probe)
+    with open(path, 'rb') as f:
+        stream = f.read()
+    if FLIGHT_RECORDER_SYNC in stream:
+        schedule = schedule_from_flight_recorder(stream)
+        if schedule:
+            return schedule
+    return schedule_from_raw(stream, period)
+
+
+def records(schedule, fast=False, speed=1.0):
+    """Encode a schedule as replay records, one per byte."""
+    out = bytearray()
+    elapsed_s = 0.0
+    sent_us = 0
+    previous = schedule[0][0]
+    for when, from_bike, byte in schedule:
+        gap_s = (when - previous) / speed
+        previous = when
+        if fast:
+            gap_s = min(gap_s, FAST_GAP_S)
+        elapsed_s += gap_s
+        # Round the running total, not each gap, so error doesn't build up
+        gap_us = int(round(elapsed_s * 1e6)) - sent_us
+        sent_us += gap_us
+        while gap_us > MAX_GAP_US:
+            out += RECORD.pack(REPLAY_SYNC, REPLAY_GAP_ONLY, MAX_GAP_US, 0)
+            gap_us -= MAX_GAP_US
+        out += RECORD.pack(REPLAY_SYNC, REPLAY_FROM_BIKE if from_bike else 0,
+                           gap_us, byte)
+    return bytes(out)
+
+
+def enter_replay(port_name):
+    with serial.Serial(port_name, 230400) as port:
+        port.write(b'replay\n')
+    # Wait out the reboot and USB re-enumeration
+    time.sleep(4)
+
+
+def write_records(path, data):
+    """Write the records send_records would send, for the host build in
+    test/."""
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def send_records(port, data):
+    """Send the records; return when sending began.
+
+    The firmware releases each byte at its time and only reads the next
+    record after that, so USB flow control paces the write.
+    """
+    start = time.time()
+    port.write(data)
+    port.flush()
+    return start
+
+
+def echo(port, out):
+    while port.is_open:
+        try:
+            data = port.read(port.in_waiting or 1)
+        except (serial.SerialException, TypeError):
+            return
+        if data:
+            out.write(data)
+            out.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Feed a recorded session to a PeloMon running in replay '
+                    'mode (the replay command), which parses it exactly as it '
+                    'would live bike traffic. Accepts raw HU+bike streams '
+                    '(peloton_decoding/*.bin), flight recorder dumps (frec) '
+                    'and sigrok sessions (.sr). Device output is copied to '
+                    'stdout or --output.')
+    parser.add_argument('port', help='USB serial port, e.g. /dev/ttyACM0, or '
+                                     'the file to write with --write')
+    parser.add_argument('capture')
+    parser.add_argument('--write', action='store_true',
+                        help='write the records to the file named by port '
+                             'instead of sending them, for the host build '
+                             'in test/')
+    parser.add_argument('--enter', action='store_true',
+                        help='send the replay command first and wait for the '
+                             'reboot')
+    parser.add_argument('--fast', action='store_true',
+                        help='cut the idle time between pairs to %dms; byte '
+                             'and reply timing is kept' % (FAST_GAP_S * 1000))
+    parser.add_argument('--speed', type=float, default=1.0,
+                        help='playback speed multiplier (default 1.0)')
+    parser.add_argument('--period', type=float, default=DEFAULT_PERIOD_S,
+                        help='seconds between HU requests for raw streams, '
+                             'which have no timestamps (default %(default)s)')
+    parser.add_argument('--hu', default='D0', help='HU probe in .sr captures')
+    parser.add_argument('--bike', default='D4',
+                        help='bike probe in .sr captures')
+    parser.add_argument('-o', '--output', type=argparse.FileType('wb'),
+                        default=getattr(sys.stdout, 'buffer', sys.stdout))
+    args = parser.parse_args()
+
+    schedule = load_schedule(args.capture, args.period, args.hu, args.bike)
+    if not schedule:
+        parser.error('no bytes found in %s' % args.capture)
+    data = records(schedule, args.fast, args.speed)
+
+    if args.write:
+        write_records(args.port, data)
+        return
+
+    if args.enter:
+        enter_replay(args.port)
+
+    port = serial.Serial(args.port, 230400, timeout=0.1)
+    reader = threading.Thread(target=echo, args=(port, args.output))
+    reader.daemon = True
+    reader.start()
+    start = send_records(port, data)
+    sys.stderr.write('Sent %d bytes in %.1fs\n' % (len(schedule),
+                                                     time.time() - start))
+    # Let the last responses come back
+    time.sleep(1)
+    port.close()
+
+
+if __name__ == '__main__':
+    main()
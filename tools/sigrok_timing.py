@@ -0,0 +1,286 @@
+#!/usr/bin/env python
+# Timing report from a sigrok capture of the Peloton bus and PIN_STATE pins
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+
+import argparse
+import configparser
+import re
+import sys
+import zipfile
+
+BAUD = 19200
+# Bytes further apart than this many byte times start a new frame
+FRAME_GAP_BYTES = 3
+# The firmware gives up on the bike after 10-11ms
+BIKE_REPLY_TIMEOUT_S = 0.011
+# Order matches the PIN_STATE_* pins in pelomon/settings.h
+PHASES = ('READ_HU', 'READ_BIKE', 'PROC_MSG', 'LISTEN_HU', 'LISTEN_BIKE',
+          'HANDLE_CMD')
+HU_STARTS = (0xF5, 0xF7, 0xFE)
+BIKE_START = 0xF1
+
+
+class Capture(object):
+    """Samples of a sigrok .sr session, one bit per probe per sample."""
+
+    def __init__(self, path):
+        with zipfile.ZipFile(path) as archive:
+            config = configparser.ConfigParser()
+            config.read_string(archive.read('metadata').decode('ascii'))
+            device = config['device 1']
+            self.samplerate = parse_samplerate(device['samplerate'])
+            if int(device.get('unitsize', '1')) != 1:
+                raise ValueError('only captures of up to 8 probes supported')
+            self.probes = {}
+            for key, name in device.items():
+                match = re.match(r'probe(\d+)$', key)
+                if match:
+                    self.probes[name] = int(match.group(1)) - 1
+            prefix = device['capturefile'] + '-'
+            chunks = sorted(
+                (name for name in archive.namelist()
+                 if name.startswith(prefix)),
+                key=lambda name: int(name[len(prefix):]))
+            self.data = b''.join(archive.read(name) for name in chunks)
+
+    def channel(self, probe):
+        """Return the probe's samples as a bytes object of 0s and 1s."""
+        bit = self.probes[probe]
+        table = bytes((value >> bit) & 1 for value in range(256))
+        return self.data.translate(table)
+
+
+def parse_samplerate(text):
+    value, _, unit = text.strip().partition(' ')
+    scale = {'': 1, 'Hz': 1, 'kHz': 1e3, 'MHz': 1e6, 'GHz': 1e9}[unit]
+    return float(value) * scale
+
+
+def high_runs(bits):
+    """Yield (start, end) sample indices of each run of 1s."""
+    for match in re.finditer(b'\x01+', bits):
+        yield match.start(), match.end()
+
+
+def decode_uart(bits, samplerate, baud=BAUD):
+    """Return [(start_sample, end_sample, byte)] for 8N1 data idling high.
+
+    The idle level is taken from the majority of samples, so raw bus
+    captures (idling low, before the inverter) decode as well.
+    """
+    if bits.count(b'\x01') < len(bits) // 2:
+        bits = bits.translate(bytes((1, 0)) + bytes(254))
+    per_bit = samplerate / baud
+    decoded = []
+    next_allowed = 0
+    for _, falling in high_runs(bits):
+        if falling < next_allowed or falling >= len(bits):
+            continue
+        stop = int(falling + per_bit * 9.5)
+        if stop >= len(bits):
+            break
+        value = 0
+        for bit in range(8):
+            value |= bits[int(falling + per_bit * (1.5 + bit))] << bit
+        if bits[stop]:
+            decoded.append((falling, int(falling + per_bit * 10), value))
+        next_allowed = stop
+    return decoded
+
+
+def frame_is_valid(data):
+    if len(data) < 4 or data[-1] != 0xF6:
+        return False
+    if data[0] == BIKE_START:
+        if data[2] + 5 != len(data):
+            return False
+    elif data[0] not in HU_STARTS or len(data) != 4:
+        return False
+    return sum(data[:-2]) & 0xFF == data[-2]
+
+
+def group_frames(decoded, samplerate, baud=BAUD):
+    """Group decoded bytes into frames: [(start_s, end_s, bytes)]."""
+    gap = FRAME_GAP_BYTES * 10 * samplerate / baud
+    frames = []
+    current = []
+    for byte in decoded:
+        if current and byte[0] - current[-1][1] > gap:
+            frames.append(current)
+            current = []
+        current.append(byte)
+    if current:
+        frames.append(current)
+    return [(frame[0][0] / samplerate, frame[-1][1] / samplerate,
+             bytes(b[2] for b in frame)) for frame in frames]
+
+
+def percentile(sorted_values, pct):
+    index = max(0, int(round(pct / 100.0 * len(sorted_values) + 0.5)) - 1)
+    return sorted_values[min(index, len(sorted_values) - 1)]
+
+
+def summarize(name, values_s):
+    if not values_s:
+        return '%-14s %6d' % (name, 0)
+    values = sorted(v * 1000 for v in values_s)
+    return '%-14s %6d %8.3f %8.3f %8.3f %8.3f %8.3f' % (
+        name, len(values), values[0], percentile(values, 50),
+        percentile(values, 90), percentile(values, 99), values[-1])
+
+
+def pair_frames(hu_frames, bike_frames):
+    """Yield (hu_frame, bike_frame or None) for each HU request."""
+    bike_index = 0
+    for hu in hu_frames:
+        while bike_index < len(bike_frames) and \
+                bike_frames[bike_index][0] < hu[1]:
+            bike_index += 1
+        reply = None
+        if bike_index < len(bike_frames) and \
+                bike_frames[bike_index][0] - hu[1] <= BIKE_REPLY_TIMEOUT_S:
+            reply = bike_frames[bike_index]
+        yield hu, reply
+
+
+def level_at(pulses, t):
+    """Whether a pin with the given high pulses was high at time t."""
+    return any(start <= t < end for start, end in pulses)
+
+
+def report(capture, hu_probe, bike_probe, phase_probes, out):
+    rate = capture.samplerate
+    hu_frames = group_frames(decode_uart(capture.channel(hu_probe), rate),
+                             rate)
+    bike_frames = group_frames(decode_uart(capture.channel(bike_probe), rate),
+                               rate)
+    pulses = {}
+    for phase, probe in phase_probes.items():
+        pulses[phase] = [(start / rate, end / rate) for start, end in
+                         high_runs(capture.channel(probe))]
+
+    pairs = list(pair_frames(hu_frames, bike_frames))
+    header = '%-14s %6s %8s %8s %8s %8s %8s' % (
+        '(ms)', 'n', 'min', 'p50', 'p90', 'p99', 'max')
+
+    out.write('Capture: %.1fs at %g Hz\n' % (len(capture.data) / rate, rate))
+    out.write('HU frames %d (%d invalid), bike frames %d (%d invalid), '
+              'unanswered requests %d\n\n' % (
+                  len(hu_frames),
+                  sum(not frame_is_valid(f[2]) for f in hu_frames),
+                  len(bike_frames),
+                  sum(not frame_is_valid(f[2]) for f in bike_frames),
+                  sum(reply is None for _, reply in pairs)))
+
+    out.write('Bus\n' + header + '\n')
+    out.write(summarize('hu_period', [b[0] - a[0] for a, b in
+                                      zip(hu_frames, hu_frames[1:])]) + '\n')
+    out.write(summarize('hu_frame', [f[1] - f[0] for f in hu_frames]) + '\n')
+    out.write(summarize('bike_latency', [reply[0] - hu[1] for hu, reply in
+                                         pairs if reply]) + '\n')
+    out.write(summarize('bike_frame', [f[1] - f[0] for f in bike_frames]) +
+              '\n')
+    if not pulses:
+        out.write('\nNo PIN_STATE probes mapped; bus timing only.\n')
+        return
+
+    out.write('\nPhases (high time per pulse)\n' + header + '\n')
+    for phase in PHASES:
+        if phase in pulses:
+            out.write(summarize(phase, [end - start for start, end in
+                                        pulses[phase]]) + '\n')
+
+    if 'PROC_MSG' not in pulses:
+        return
+    # Line each answered request up with the PROC_MSG pulse that handled
+    # it: the first one starting after the bike reply ends and before the
+    # next HU request starts. No such pulse means the firmware missed it.
+    proc = pulses['PROC_MSG']
+    handle_latency, slack, missed = [], [], []
+    proc_index = 0
+    for i, (hu, reply) in enumerate(pairs):
+        if reply is None or not frame_is_valid(hu[2]) or \
+                not frame_is_valid(reply[2]):
+            continue
+        next_hu = pairs[i + 1][0][0] if i + 1 < len(pairs) else None
+        while proc_index < len(proc) and proc[proc_index][0] < reply[1]:
+            proc_index += 1
+        if proc_index < len(proc) and \
+                (next_hu is None or proc[proc_index][0] < next_hu):
+            start, end = proc[proc_index]
+            handle_latency.append(end - hu[0])
+            if next_hu is not None:
+                slack.append(next_hu - end)
+        else:
+            missed.append((hu, reply))
+    out.write('\nAlignment\n' + header + '\n')
+    out.write(summarize('hu_to_done', handle_latency) + '\n')
+    out.write(summarize('done_to_next', slack) + '\n')
+
+    out.write('\nMissed pairs: %d\n' % len(missed))
+    for hu, reply in missed:
+        cause = ''
+        if 'LISTEN_HU' in pulses and not level_at(pulses['LISTEN_HU'], hu[0]):
+            cause = ' (not listening to HU)'
+        elif 'HANDLE_CMD' in pulses and \
+                level_at(pulses['HANDLE_CMD'], hu[0]):
+            cause = ' (handling a command)'
+        out.write('  %10.4fs HU %s bike %s%s\n' % (
+            hu[0], hu[2].hex(), reply[2].hex(), cause))
+
+
+def find_probe(probes, *names):
+    for probe in probes:
+        bare = probe.upper()
+        if bare.startswith('PIN_STATE_'):
+            bare = bare[len('PIN_STATE_'):]
+        if bare in names:
+            return probe
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode the HU and bike UARTs in a sigrok/PulseView '
+                    'session, line them up against the PIN_STATE_* debug '
+                    'pins, and report phase timing and missed frames. '
+                    'Probes named HU, BIKE or after a phase (READ_HU, '
+                    'PIN_STATE_READ_HU, ...) are mapped automatically.')
+    parser.add_argument('session', help='.sr file')
+    parser.add_argument('--hu', help='probe with the HU line (default: probe '
+                        'named HU, else D0)')
+    parser.add_argument('--bike', help='probe with the bike line (default: '
+                        'probe named BIKE, else D4)')
+    parser.add_argument('--pin', action='append', default=[],
+                        metavar='PHASE=PROBE',
+                        help='map a phase to a probe, e.g. PROC_MSG=D2')
+    args = parser.parse_args()
+
+    capture = Capture(args.session)
+    hu = args.hu or find_probe(capture.probes, 'HU') or 'D0'
+    bike = args.bike or find_probe(capture.probes, 'BIKE') or 'D4'
+    phase_probes = {}
+    for phase in PHASES:
+        probe = find_probe(capture.probes, phase)
+        if probe is not None:
+            phase_probes[phase] = probe
+    for mapping in args.pin:
+        phase, _, probe = mapping.partition('=')
+        phase = phase.upper().replace('PIN_STATE_', '')
+        if phase not in PHASES:
+            parser.error('unknown phase %s; expected one of %s' %
+                         (phase, ', '.join(PHASES)))
+        phase_probes[phase] = probe
+    for probe in [hu, bike] + list(phase_probes.values()):
+        if probe not in capture.probes:
+            parser.error('no probe %s in capture (have %s)' %
+                         (probe, ', '.join(sorted(capture.probes))))
+    report(capture, hu, bike, phase_probes, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
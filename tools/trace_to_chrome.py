@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+# Convert PeloMon `trace` command output to Chrome/Perfetto trace JSON
+# Part of the PeloMon project: https://github.com/ihaque/pelomon
+#
+# Copyright 2020 Imran S Haque (imran@ihaque.org)
+# Licensed under the CC-BY-NC 4.0 license
+# (https://creativecommons.org/licenses/by-nc/4.0/).
+
+import argparse
+import json
+import sys
+
+MICROS_WRAP = 1 << 32
+# One track per state pin, in the order the loop visits them
+TRACKS = ('LISTEN_HU', 'READ_HU', 'LISTEN_BIKE', 'READ_BIKE', 'PROC_MSG',
+          'HANDLE_CMD')
+
+
+def parse_trace(lines):
+    """Yield (timestamp_us, name, phase) from 'T <us> <name> <B|E>' lines.
+
+    Each dump is oldest-first; successive dumps are concatenated, and
+    micros() wraparound (every ~71 minutes) is unwrapped.
+    """
+    offset = 0
+    last = None
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 4 or fields[0] != 'T' or fields[3] not in 'BE':
+            continue
+        raw = int(fields[1])
+        if last is not None and raw + offset < last - MICROS_WRAP // 2:
+            offset += MICROS_WRAP
+        last = raw + offset
+        yield last, fields[2], fields[3]
+
+
+def to_chrome(events):
+    trace = [{'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': tid,
+              'args': {'name': name}} for tid, name in enumerate(TRACKS)]
+    open_spans = set()
+    for ts, name, phase in events:
+        tid = TRACKS.index(name) if name in TRACKS else len(TRACKS)
+        if phase == 'E' and name not in open_spans:
+            # Its begin fell off the firmware's ring
+            continue
+        if phase == 'B':
+            open_spans.add(name)
+        else:
+            open_spans.discard(name)
+        trace.append({'name': name, 'ph': phase, 'ts': ts, 'pid': 1,
+                      'tid': tid})
+    return {'traceEvents': trace, 'displayTimeUnit': 'ms'}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Convert PeloMon trace dumps (log text containing the '
+                    'output of the trace command) to Chrome trace JSON for '
+                    'chrome://tracing or ui.perfetto.dev.')
+    parser.add_argument('input', nargs='?', type=argparse.FileType('r'),
+                        default=sys.stdin)
+    parser.add_argument('-o', '--output', type=argparse.FileType('w'),
+                        default=sys.stdout)
+    args = parser.parse_args()
+    json.dump(to_chrome(parse_trace(args.input)), args.output, indent=1)
+
+
+if __name__ == '__main__':
+    main()